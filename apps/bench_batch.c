@@ -0,0 +1,119 @@
+/*
+ * Batched semaphore benchmark
+ *
+ * A producer and a consumer go through a bounded buffer, like sem_buffer, but
+ * move items in batches: each side takes and releases a whole batch of slots
+ * with sem_down_n() and sem_up_n(). The throughput is printed for batches of 1
+ * (i.e., sem_down() and sem_up()), 8 and 64 items. Exits with status 1 if the
+ * consumer's checksum is wrong, i.e., an item was lost or read twice.
+ *
+ * Arguments: number of items, number of workers.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define ITEMS 4000000
+#define BUFFER_SIZE 256
+
+static unsigned int items = ITEMS;
+static unsigned int batch;
+static unsigned int buffer[BUFFER_SIZE];
+static sem_t empty, full;
+static unsigned long long sum;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void consumer(void *arg)
+{
+	(void)arg;
+
+	for (unsigned int i = 0; i < items; i += batch)
+	{
+		sem_down_n(full, batch);
+		for (unsigned int j = i; j < i + batch; j++)
+			sum += buffer[j % BUFFER_SIZE];
+		sem_up_n(empty, batch);
+	}
+}
+
+static void producer(void *arg)
+{
+	(void)arg;
+
+	uthread_create(consumer, NULL);
+
+	for (unsigned int i = 0; i < items; i += batch)
+	{
+		sem_down_n(empty, batch);
+		for (unsigned int j = i; j < i + batch; j++)
+			buffer[j % BUFFER_SIZE] = j;
+		sem_up_n(full, batch);
+	}
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+	if (ret == LONG_MIN || ret == LONG_MAX)
+	{
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	static const unsigned int batches[] = {1, 8, 64};
+	uthread_run_attr_t attr;
+	int status = 0;
+
+	uthread_run_attr_init(&attr);
+	if (argc > 1)
+		items = get_argv(argv[1]);
+	if (argc > 2)
+		attr.workers = get_argv(argv[2]);
+
+	for (size_t i = 0; i < sizeof(batches) / sizeof(batches[0]); i++)
+	{
+		unsigned long long start;
+
+		batch = batches[i];
+		items -= items % batch;
+		empty = sem_create(BUFFER_SIZE);
+		full = sem_create(0);
+		sum = 0;
+
+		start = now_ns();
+		if (uthread_run_attr(&attr, producer, NULL) == -1)
+		{
+			fprintf(stderr, "uthread_run_attr failed\n");
+			return 1;
+		}
+
+		bool ok = sum == (unsigned long long)items * (items - 1) / 2;
+
+		printf("batch %2u: %6.1f M items/s (checksum %s)\n", batch,
+			   items / ((now_ns() - start) / 1e3), ok ? "ok" : "wrong");
+		if (!ok)
+			status = 1;
+
+		sem_destroy(empty);
+		sem_destroy(full);
+	}
+
+	return status;
+}
@@ -0,0 +1,218 @@
+/*
+ * Channel benchmark
+ *
+ * The prime sieve of sem_prime, with its pipeline of filter threads connected
+ * by channels: first hand-rolled from two semaphores and a value slot, like in
+ * sem_prime, then with unbuffered and buffered uthread_chan_t channels. The
+ * number of messages going through the pipeline per second is printed, along
+ * with the number of primes found.
+ *
+ * Arguments: largest number to check, capacity of the buffered channels.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <chan.h>
+#include <sem.h>
+#include <uthread.h>
+
+#define MAXPRIME 20000
+#define CAPACITY 16
+
+enum mode
+{
+	MODE_SEM,
+	MODE_UNBUFFERED,
+	MODE_BUFFERED,
+};
+
+static const char *const mode_names[] = {"semaphores", "unbuffered", "buffered"};
+
+struct channel
+{
+	int value;
+	sem_t produce;
+	sem_t consume;
+	uthread_chan_t chan;
+};
+
+struct filter
+{
+	struct channel *left;
+	struct channel *right;
+	int prime;
+};
+
+static unsigned int max = MAXPRIME;
+static unsigned int capacity = CAPACITY;
+static enum mode mode;
+static unsigned long messages;
+static unsigned int primes;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct channel *channel_create(void)
+{
+	struct channel *c = malloc(sizeof(*c));
+
+	if (mode == MODE_SEM)
+	{
+		c->produce = sem_create(0);
+		c->consume = sem_create(0);
+	}
+	else
+	{
+		c->chan = uthread_chan_create(sizeof(int),
+									  mode == MODE_BUFFERED ? capacity : 0);
+	}
+
+	return c;
+}
+
+static void channel_destroy(struct channel *c)
+{
+	if (mode == MODE_SEM)
+	{
+		sem_destroy(c->produce);
+		sem_destroy(c->consume);
+	}
+	else
+	{
+		uthread_chan_destroy(c->chan);
+	}
+
+	free(c);
+}
+
+static void send(struct channel *c, int value)
+{
+	messages++;
+
+	if (mode == MODE_SEM)
+	{
+		c->value = value;
+		sem_up(c->consume);
+		sem_down(c->produce);
+	}
+	else
+	{
+		uthread_chan_send(c->chan, &value);
+	}
+}
+
+static int recv(struct channel *c)
+{
+	int value;
+
+	if (mode == MODE_SEM)
+	{
+		sem_down(c->consume);
+		value = c->value;
+		sem_up(c->produce);
+	}
+	else
+	{
+		uthread_chan_recv(c->chan, &value);
+	}
+
+	return value;
+}
+
+/* Producer thread: produces all numbers, from 2 to max */
+static void source(void *arg)
+{
+	struct channel *c = arg;
+
+	for (unsigned int i = 2; i <= max; i++)
+		send(c, i);
+
+	/* mark completion */
+	send(c, -1);
+}
+
+/* Filter thread */
+static void filter(void *arg)
+{
+	struct filter *f = arg;
+	int value;
+
+	do
+	{
+		value = recv(f->left);
+		if (value == -1 || value % f->prime != 0)
+			send(f->right, value);
+	} while (value != -1);
+
+	channel_destroy(f->left);
+	free(f);
+}
+
+/* Consumer thread */
+static void sink(void *arg)
+{
+	struct channel *p = channel_create();
+	int value;
+	(void)arg;
+
+	uthread_create(source, p);
+
+	while ((value = recv(p)) != -1)
+	{
+		struct filter *f = malloc(sizeof(*f));
+
+		primes++;
+
+		f->left = p;
+		f->prime = value;
+		p = channel_create();
+		f->right = p;
+
+		uthread_create(filter, f);
+	}
+
+	channel_destroy(p);
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+	if (ret == LONG_MIN || ret == LONG_MAX)
+	{
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1)
+		max = get_argv(argv[1]);
+	if (argc > 2)
+		capacity = get_argv(argv[2]);
+
+	for (mode = MODE_SEM; mode <= MODE_BUFFERED; mode++)
+	{
+		unsigned long long start;
+
+		messages = 0;
+		primes = 0;
+
+		start = now_ns();
+		uthread_run(false, sink, NULL);
+
+		printf("%-10s %5.2f M messages/s, %u primes\n", mode_names[mode],
+			   messages / ((now_ns() - start) / 1e3), primes);
+	}
+
+	return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * Condition variable benchmark
+ *
+ * Many consumers wait for the same event, which a producer announces for a
+ * number of rounds. Each round, the producer wakes every consumer up and waits
+ * until they all saw the event. The consumers are woken up by a broadcast, by
+ * signaling them one by one, or with a semaphore: the producer calls sem_up()
+ * once per consumer, and a consumer that took the semaphore before the event
+ * (i.e., a token meant for another one) gives it back and tries again. The
+ * time per wakeup is printed.
+ *
+ * Arguments: number of consumers, number of rounds, number of workers.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <cond.h>
+#include <mutex.h>
+#include <sem.h>
+#include <uthread.h>
+
+#define CONSUMERS 500
+#define ROUNDS 2000
+
+enum wake
+{
+	WAKE_BROADCAST,
+	WAKE_SIGNAL,
+	WAKE_SEM,
+};
+
+static const char *const wake_names[] = {"broadcast", "signal", "sem"};
+
+static unsigned int consumers = CONSUMERS;
+static unsigned int rounds = ROUNDS;
+static enum wake wake;
+
+static uthread_mutex_t mutex = UTHREAD_MUTEX_INITIALIZER;
+static uthread_cond_t event = UTHREAD_COND_INITIALIZER;
+static uthread_cond_t all_seen = UTHREAD_COND_INITIALIZER;
+static sem_t event_sem;
+static unsigned int generation, seen;
+static unsigned long total_seen;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void consumer(void *arg)
+{
+	(void)arg;
+
+	for (unsigned int round = 1; round <= rounds; round++)
+	{
+		if (wake == WAKE_SEM)
+		{
+			sem_down(event_sem);
+			uthread_mutex_lock(&mutex);
+			while (generation < round)
+			{
+				uthread_mutex_unlock(&mutex);
+				sem_up(event_sem);
+				uthread_yield();
+				sem_down(event_sem);
+				uthread_mutex_lock(&mutex);
+			}
+		}
+		else
+		{
+			uthread_mutex_lock(&mutex);
+			while (generation < round)
+				uthread_cond_wait(&event, &mutex);
+		}
+
+		total_seen++;
+		if (++seen == consumers)
+			uthread_cond_signal(&all_seen);
+		uthread_mutex_unlock(&mutex);
+	}
+}
+
+static void producer(void *arg)
+{
+	(void)arg;
+
+	for (unsigned int i = 0; i < consumers; i++)
+		uthread_create(consumer, NULL);
+
+	for (unsigned int round = 1; round <= rounds; round++)
+	{
+		uthread_mutex_lock(&mutex);
+		seen = 0;
+		generation = round;
+
+		switch (wake)
+		{
+		case WAKE_BROADCAST:
+			uthread_cond_broadcast(&event);
+			break;
+		case WAKE_SIGNAL:
+			for (unsigned int i = 0; i < consumers; i++)
+				uthread_cond_signal(&event);
+			break;
+		case WAKE_SEM:
+			for (unsigned int i = 0; i < consumers; i++)
+				sem_up(event_sem);
+			break;
+		}
+
+		while (seen < consumers)
+			uthread_cond_wait(&all_seen, &mutex);
+		uthread_mutex_unlock(&mutex);
+	}
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+	if (ret == LONG_MIN || ret == LONG_MAX)
+	{
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	uthread_run_attr_t attr;
+
+	uthread_run_attr_init(&attr);
+	if (argc > 1)
+		consumers = get_argv(argv[1]);
+	if (argc > 2)
+		rounds = get_argv(argv[2]);
+	if (argc > 3)
+		attr.workers = get_argv(argv[3]);
+
+	event_sem = sem_create(0);
+
+	for (wake = WAKE_BROADCAST; wake <= WAKE_SEM; wake++)
+	{
+		unsigned long long start;
+
+		generation = 0;
+		total_seen = 0;
+		start = now_ns();
+		if (uthread_run_attr(&attr, producer, NULL) == -1)
+		{
+			fprintf(stderr, "uthread_run_attr failed\n");
+			return 1;
+		}
+
+		printf("%-9s %6.1f ns per wakeup (%s)\n", wake_names[wake],
+			   (double)(now_ns() - start) / consumers / rounds,
+			   total_seen == (unsigned long)consumers * rounds ? "ok" : "wrong");
+	}
+
+	sem_destroy(event_sem);
+
+	return 0;
+}
@@ -0,0 +1,91 @@
+/*
+ * Thread creation rate benchmark
+ *
+ * A spawner thread repeatedly creates a batch of threads that exit right away,
+ * and waits for the whole batch to be collected before starting the next one.
+ * The average rate of thread creation (and exit) is printed, once the stack
+ * pool and the TCB slabs have been warmed up by the first batch.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <uthread.h>
+
+#define BATCH 1000
+#define ROUNDS 1000
+
+static size_t rounds = ROUNDS;
+static size_t done;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void worker(void *arg)
+{
+	(void)arg;
+
+	done++;
+}
+
+static void run_batch(void)
+{
+	done = 0;
+	for (size_t i = 0; i < BATCH; i++)
+	{
+		if (uthread_create(worker, NULL) == -1)
+		{
+			fprintf(stderr, "uthread_create failed\n");
+			exit(1);
+		}
+	}
+
+	/* Workers exit in FIFO order, the whole batch is gone after a yield */
+	while (done < BATCH)
+		uthread_yield();
+}
+
+static void spawner(void *arg)
+{
+	unsigned long long start, end;
+	(void)arg;
+
+	/* Warm up */
+	run_batch();
+
+	start = now_ns();
+	for (size_t r = 0; r < rounds; r++)
+		run_batch();
+	end = now_ns();
+
+	printf("%zu threads in %.3f s: %.0f creates/s\n", rounds * BATCH,
+		   (end - start) / 1e9, rounds * BATCH / ((end - start) / 1e9));
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+	if (ret == LONG_MIN || ret == LONG_MAX)
+	{
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1)
+		rounds = get_argv(argv[1]);
+
+	uthread_run(false, spawner, NULL);
+
+	return 0;
+}
@@ -0,0 +1,257 @@
+/*
+ * Loopback TCP echo benchmark
+ *
+ * A server and its clients run in the same process: one thread accepts
+ * connections and starts a thread echoing back everything received on each,
+ * while one client thread per connection sends small requests and waits for
+ * every reply before sending the next. All the connections are open at the
+ * same time, and the number of requests (round trips) per second is printed.
+ * Exits with status 1 if a call fails, a reply doesn't match its request, or
+ * not every round trip completed.
+ *
+ * Arguments: number of connections (clamped to the file descriptor limit),
+ * requests per connection, number of workers.
+ */
+
+#include <arpa/inet.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include <io.h>
+#include <uthread.h>
+
+#define CONNECTIONS 10000
+#define REQUESTS 100
+#define MESSAGE_SIZE 64
+#define STACK_SIZE 16384
+
+static unsigned int connections = CONNECTIONS;
+static unsigned int requests = REQUESTS;
+static struct sockaddr_in server_addr;
+static int listen_fd;
+static unsigned int failures;
+static unsigned long long completed;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void fail(const char *what)
+{
+	perror(what);
+	__atomic_add_fetch(&failures, 1, __ATOMIC_RELAXED);
+}
+
+static void spawn(uthread_func_t func, void *arg)
+{
+	uthread_attr_t attr;
+
+	uthread_attr_init(&attr);
+	attr.stack_size = STACK_SIZE;
+	if (uthread_create_attr(&attr, func, arg) == -1)
+	{
+		fprintf(stderr, "uthread_create_attr failed\n");
+		exit(1);
+	}
+}
+
+/* Read exactly @len bytes, unless the peer closes the connection */
+static ssize_t read_full(int fd, char *buf, size_t len)
+{
+	size_t done = 0;
+
+	while (done < len)
+	{
+		ssize_t ret = uthread_read(fd, buf + done, len - done);
+
+		if (ret <= 0)
+			return ret;
+		done += ret;
+	}
+	return done;
+}
+
+static int write_full(int fd, const char *buf, size_t len)
+{
+	size_t done = 0;
+
+	while (done < len)
+	{
+		ssize_t ret = uthread_write(fd, buf + done, len - done);
+
+		if (ret == -1)
+			return -1;
+		done += ret;
+	}
+	return 0;
+}
+
+static void echo(void *arg)
+{
+	int fd = (int)(long)arg;
+	char buf[MESSAGE_SIZE];
+	ssize_t len;
+
+	while ((len = uthread_read(fd, buf, sizeof(buf))) > 0)
+	{
+		if (write_full(fd, buf, len) == -1)
+		{
+			fail("write");
+			break;
+		}
+	}
+	if (len == -1)
+		fail("read");
+
+	uthread_close(fd);
+}
+
+static void acceptor(void *arg)
+{
+	(void)arg;
+
+	for (unsigned int i = 0; i < connections; i++)
+	{
+		int fd = uthread_accept(listen_fd, NULL, NULL);
+
+		if (fd == -1)
+		{
+			fail("accept");
+			return;
+		}
+		spawn(echo, (void *)(long)fd);
+	}
+}
+
+static void client(void *arg)
+{
+	char request[MESSAGE_SIZE], reply[MESSAGE_SIZE];
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	(void)arg;
+
+	if (fd == -1)
+	{
+		fail("socket");
+		return;
+	}
+
+	if (uthread_connect(fd, (struct sockaddr *)&server_addr,
+						sizeof(server_addr)) == -1)
+	{
+		fail("connect");
+		uthread_close(fd);
+		return;
+	}
+
+	for (unsigned int i = 0; i < requests; i++)
+	{
+		memset(request, 'a' + i % 26, sizeof(request));
+		if (write_full(fd, request, sizeof(request)) == -1 ||
+			read_full(fd, reply, sizeof(reply)) != sizeof(reply))
+		{
+			fail("request");
+			break;
+		}
+		if (memcmp(request, reply, sizeof(reply)) != 0)
+		{
+			fprintf(stderr, "reply doesn't match the request\n");
+			__atomic_add_fetch(&failures, 1, __ATOMIC_RELAXED);
+			break;
+		}
+		__atomic_add_fetch(&completed, 1, __ATOMIC_RELAXED);
+	}
+
+	uthread_close(fd);
+}
+
+static void bench(void *arg)
+{
+	(void)arg;
+
+	spawn(acceptor, NULL);
+	for (unsigned int i = 0; i < connections; i++)
+		spawn(client, NULL);
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+	if (ret == LONG_MIN || ret == LONG_MAX)
+	{
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	uthread_run_attr_t attr;
+	struct rlimit limit;
+	socklen_t len = sizeof(server_addr);
+
+	uthread_run_attr_init(&attr);
+	if (argc > 1)
+		connections = get_argv(argv[1]);
+	if (argc > 2)
+		requests = get_argv(argv[2]);
+	if (argc > 3)
+		attr.workers = get_argv(argv[3]);
+
+	/* Each connection takes two file descriptors, leave a few for the rest */
+	getrlimit(RLIMIT_NOFILE, &limit);
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+	if (limit.rlim_cur < 2ULL * connections + 16)
+	{
+		connections = (limit.rlim_cur - 16) / 2;
+		fprintf(stderr, "file descriptor limit: %u connections\n",
+				connections);
+	}
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&server_addr, 0, sizeof(server_addr));
+	server_addr.sin_family = AF_INET;
+	server_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (listen_fd == -1 ||
+		bind(listen_fd, (struct sockaddr *)&server_addr,
+			 sizeof(server_addr)) == -1 ||
+		listen(listen_fd, SOMAXCONN) == -1 ||
+		getsockname(listen_fd, (struct sockaddr *)&server_addr, &len) == -1)
+	{
+		perror("listen");
+		return 1;
+	}
+
+	unsigned long long start = now_ns();
+
+	if (uthread_run_attr(&attr, bench, NULL) == -1)
+	{
+		fprintf(stderr, "uthread_run_attr failed\n");
+		return 1;
+	}
+
+	double secs = (now_ns() - start) / 1e9;
+
+	printf("%u connections, %u requests each: %.0f requests/s (%u failures)\n",
+		   connections, requests, (double)connections * requests / secs,
+		   failures);
+
+	if (completed != (unsigned long long)connections * requests)
+	{
+		fprintf(stderr, "%llu round trips completed\n", completed);
+		return 1;
+	}
+
+	return failures != 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * Scheduling fairness benchmark
+ *
+ * Two CPU-bound threads run side by side for a second with a 1ms quantum. The
+ * first one is adversarial: it yields after 90% of a quantum, right before the
+ * next tick, so that the tick preempts the other thread almost as soon as it
+ * gets the CPU. Both threads do the same work in a loop, and the share of the
+ * total work each one did is printed.
+ *
+ * Arguments: scheduling policy (0: FIFO, 1: MLFQ, 2: fair), weight of the
+ * second thread.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <uthread.h>
+
+#define DURATION_NS 1000000000ULL
+#define QUANTUM_US 1000
+
+struct worker
+{
+	unsigned long long work;
+	int adversarial;
+};
+
+static struct worker workers[2];
+static unsigned int weight = UTHREAD_WEIGHT_DEFAULT;
+static unsigned long long deadline;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void worker(void *arg)
+{
+	struct worker *w = (struct worker *)arg;
+	unsigned long long now, slice_start = now_ns();
+
+	while ((now = now_ns()) < deadline)
+	{
+		w->work++;
+
+		if (w->adversarial && now - slice_start > QUANTUM_US * 900ULL)
+		{
+			uthread_yield();
+			slice_start = now_ns();
+		}
+	}
+}
+
+static void bench(void *arg)
+{
+	uthread_attr_t attr;
+	(void)arg;
+
+	deadline = now_ns() + DURATION_NS;
+
+	workers[0].adversarial = 1;
+	uthread_create(worker, &workers[0]);
+
+	uthread_attr_init(&attr);
+	attr.weight = weight;
+	uthread_create_attr(&attr, worker, &workers[1]);
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+	if (ret == LONG_MIN || ret == LONG_MAX)
+	{
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	uthread_run_attr_t attr;
+	unsigned long long total;
+
+	uthread_run_attr_init(&attr);
+	attr.preempt = true;
+	attr.quantum_us = QUANTUM_US;
+	attr.clock = UTHREAD_CLOCK_MONOTONIC;
+	if (argc > 1)
+		attr.sched = get_argv(argv[1]);
+	if (argc > 2)
+		weight = get_argv(argv[2]);
+
+	if (uthread_run_attr(&attr, bench, NULL) == -1)
+	{
+		fprintf(stderr, "uthread_run_attr failed\n");
+		return 1;
+	}
+
+	total = workers[0].work + workers[1].work;
+	printf("adversarial: %.1f%%, other: %.1f%%\n",
+		   100.0 * workers[0].work / total, 100.0 * workers[1].work / total);
+
+	return 0;
+}
@@ -0,0 +1,182 @@
+/*
+ * File I/O benchmark
+ *
+ * Many threads read random 4KB blocks of a large file opened with O_DIRECT, so
+ * that every read goes to the storage device, using:
+ * - blocking: plain pread(), which blocks the whole library for each read
+ * - pool: uthread_pread() with helper kernel threads
+ * - io_uring: uthread_pread() with io_uring
+ * and the number of reads per second of each is printed.
+ *
+ * Arguments: file size (in MB), number of threads, reads per thread, number of
+ * workers. The file is created in the current directory, and removed once
+ * done.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <io.h>
+#include <uthread.h>
+
+#define FILE_NAME "bench_file.dat"
+#define FILE_MB 256
+#define THREADS 256
+#define READS 64
+#define BLOCK_SIZE 4096
+
+enum mode
+{
+	BLOCKING,
+	POOL,
+	URING,
+};
+
+static unsigned int blocks;
+static unsigned int threads = THREADS;
+static unsigned int reads = READS;
+static enum mode mode;
+static int fd;
+static unsigned int failures;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void reader(void *arg)
+{
+	unsigned int seed = (unsigned int)(long)arg;
+	char *buf = aligned_alloc(BLOCK_SIZE, BLOCK_SIZE);
+
+	for (unsigned int i = 0; i < reads; i++)
+	{
+		off_t offset = (off_t)(rand_r(&seed) % blocks) * BLOCK_SIZE;
+		ssize_t ret;
+
+		if (mode == BLOCKING)
+			ret = pread(fd, buf, BLOCK_SIZE, offset);
+		else
+			ret = uthread_pread(fd, buf, BLOCK_SIZE, offset);
+
+		if (ret != BLOCK_SIZE)
+			__atomic_add_fetch(&failures, 1, __ATOMIC_RELAXED);
+	}
+
+	free(buf);
+}
+
+static void bench(void *arg)
+{
+	(void)arg;
+
+	for (unsigned int i = 0; i < threads; i++)
+		uthread_create(reader, (void *)(long)(i + 1));
+}
+
+static int create_file(unsigned int mb)
+{
+	char *buf = malloc(1 << 20);
+	int out = open(FILE_NAME, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+
+	if (out == -1)
+		return -1;
+
+	memset(buf, 'x', 1 << 20);
+	for (unsigned int i = 0; i < mb; i++)
+	{
+		if (write(out, buf, 1 << 20) != 1 << 20)
+		{
+			close(out);
+			return -1;
+		}
+	}
+
+	free(buf);
+	fsync(out);
+	return close(out);
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+	if (ret == LONG_MIN || ret == LONG_MAX)
+	{
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	static const char *names[] = {"blocking", "pool", "io_uring"};
+	unsigned int mb = FILE_MB;
+	unsigned int workers = 1;
+
+	if (argc > 1)
+		mb = get_argv(argv[1]);
+	if (argc > 2)
+		threads = get_argv(argv[2]);
+	if (argc > 3)
+		reads = get_argv(argv[3]);
+	if (argc > 4)
+		workers = get_argv(argv[4]);
+
+	blocks = mb * ((1 << 20) / BLOCK_SIZE);
+
+	if (create_file(mb) == -1)
+	{
+		perror("create");
+		return 1;
+	}
+
+	fd = open(FILE_NAME, O_RDONLY | O_DIRECT);
+	if (fd == -1)
+	{
+		perror("open");
+		unlink(FILE_NAME);
+		return 1;
+	}
+
+	for (mode = BLOCKING; mode <= URING; mode++)
+	{
+		uthread_run_attr_t attr;
+		unsigned long long start = now_ns();
+
+		uthread_run_attr_init(&attr);
+		attr.workers = workers;
+		attr.io_uring = mode == URING;
+
+		if (uthread_run_attr(&attr, bench, NULL) == -1)
+		{
+			fprintf(stderr, "uthread_run_attr failed\n");
+			break;
+		}
+
+		double secs = (now_ns() - start) / 1e9;
+
+		printf("%-8s %10.0f reads/s\n", names[mode],
+			   (double)threads * reads / secs);
+	}
+
+	close(fd);
+	unlink(FILE_NAME);
+
+	if (failures != 0)
+	{
+		fprintf(stderr, "%u failed reads\n", failures);
+		return 1;
+	}
+
+	return 0;
+}
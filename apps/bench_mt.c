@@ -0,0 +1,188 @@
+/*
+ * Multicore scaling benchmark
+ *
+ * Runs independent prime sieve pipelines (same structure as sem_prime: one
+ * thread per prime found, handing numbers over through pairs of semaphores)
+ * with 1, 2, 4, ... workers, and prints the throughput of each run in numbers
+ * sieved per second.
+ *
+ * Arguments: maximum number of workers, number of pipelines, largest number
+ * sieved by each pipeline.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define MAX_WORKERS 4
+#define PIPELINES 64
+#define MAXPRIME 2000
+
+struct channel
+{
+	int value;
+	sem_t produce;
+	sem_t consume;
+};
+
+struct filter
+{
+	struct channel *left;
+	unsigned int prime;
+};
+
+static unsigned int pipelines = PIPELINES;
+static unsigned int max = MAXPRIME;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct channel *channel_create(void)
+{
+	struct channel *c = malloc(sizeof(*c));
+
+	c->produce = sem_create(0);
+	c->consume = sem_create(0);
+	return c;
+}
+
+static void channel_destroy(struct channel *c)
+{
+	sem_destroy(c->produce);
+	sem_destroy(c->consume);
+	free(c);
+}
+
+static void channel_send(struct channel *c, int value)
+{
+	c->value = value;
+	sem_up(c->consume);
+	sem_down(c->produce);
+}
+
+static int channel_recv(struct channel *c)
+{
+	int value;
+
+	sem_down(c->consume);
+	value = c->value;
+	sem_up(c->produce);
+	return value;
+}
+
+/* Filters out multiples of its prime, and starts the next filter */
+static void filter(void *arg)
+{
+	struct filter *f = (struct filter *)arg;
+	struct channel *right = NULL;
+	int value;
+
+	do
+	{
+		value = channel_recv(f->left);
+		if (value != -1 && value % f->prime == 0)
+			continue;
+
+		if (right == NULL && value != -1)
+		{
+			struct filter *next = malloc(sizeof(*next));
+
+			right = channel_create();
+			next->left = right;
+			next->prime = value;
+			uthread_create(filter, next);
+			continue;
+		}
+
+		if (right != NULL)
+			channel_send(right, value);
+	} while (value != -1);
+
+	/*
+	 * The receiving end may not be done with a channel until the sender's
+	 * last channel_send() returns, so senders destroy channels
+	 */
+	if (right != NULL)
+		channel_destroy(right);
+	free(f);
+}
+
+static void source(void *arg)
+{
+	struct filter *f = malloc(sizeof(*f));
+	struct channel *c = channel_create();
+	(void)arg;
+
+	f->left = c;
+	f->prime = 2;
+	uthread_create(filter, f);
+
+	for (unsigned int i = 3; i <= max; i++)
+		channel_send(c, i);
+	channel_send(c, -1);
+	channel_destroy(c);
+}
+
+static void bench(void *arg)
+{
+	(void)arg;
+
+	for (unsigned int i = 0; i < pipelines; i++)
+		uthread_create(source, NULL);
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+	if (ret == LONG_MIN || ret == LONG_MAX)
+	{
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int max_workers = MAX_WORKERS;
+	double base = 0;
+
+	if (argc > 1)
+		max_workers = get_argv(argv[1]);
+	if (argc > 2)
+		pipelines = get_argv(argv[2]);
+	if (argc > 3)
+		max = get_argv(argv[3]);
+
+	/* Warm up the stack pool and TCB slabs */
+	uthread_run_mt(1, false, bench, NULL);
+
+	for (unsigned int workers = 1; workers <= max_workers; workers *= 2)
+	{
+		unsigned long long start = now_ns();
+
+		if (uthread_run_mt(workers, false, bench, NULL) == -1)
+		{
+			fprintf(stderr, "uthread_run_mt failed\n");
+			return 1;
+		}
+
+		double rate = (double)pipelines * (max - 2) /
+					  ((now_ns() - start) / 1e9);
+		if (workers == 1)
+			base = rate;
+		printf("%2u workers: %.2f M numbers/s (x%.2f)\n", workers, rate / 1e6,
+			   rate / base);
+	}
+
+	return 0;
+}
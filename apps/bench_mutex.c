@@ -0,0 +1,150 @@
+/*
+ * Mutex benchmark
+ *
+ * Compares a uthread_mutex_t with a semaphore created with a count of 1, the
+ * way mutual exclusion was done before mutexes existed. First a single thread
+ * locks and unlocks without contention, then several threads increment a
+ * shared counter and yield while holding the lock every few iterations, so
+ * that the others have to wait for it. The time per lock/unlock pair is
+ * printed, and the counter is checked.
+ *
+ * Arguments: number of iterations, number of threads, number of workers.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <mutex.h>
+#include <sem.h>
+#include <uthread.h>
+
+#define ITERATIONS 4000000
+#define THREADS 8
+#define YIELD_EVERY 16
+
+static unsigned int iterations = ITERATIONS;
+static unsigned int threads = THREADS;
+static unsigned int per_thread;
+static bool use_sem;
+static uthread_mutex_t mutex = UTHREAD_MUTEX_INITIALIZER;
+static sem_t sem;
+static unsigned long counter;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void lock(void)
+{
+	if (use_sem)
+		sem_down(sem);
+	else
+		uthread_mutex_lock(&mutex);
+}
+
+static void unlock(void)
+{
+	if (use_sem)
+		sem_up(sem);
+	else
+		uthread_mutex_unlock(&mutex);
+}
+
+static void uncontended(void *arg)
+{
+	(void)arg;
+
+	for (unsigned int i = 0; i < iterations; i++)
+	{
+		lock();
+		counter++;
+		unlock();
+	}
+}
+
+static void incrementer(void *arg)
+{
+	(void)arg;
+
+	for (unsigned int i = 0; i < per_thread; i++)
+	{
+		lock();
+		counter++;
+		if (i % YIELD_EVERY == 0)
+			uthread_yield();
+		unlock();
+	}
+}
+
+static void contended(void *arg)
+{
+	(void)arg;
+
+	for (unsigned int i = 0; i < threads; i++)
+		uthread_create(incrementer, NULL);
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+	if (ret == LONG_MIN || ret == LONG_MAX)
+	{
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+static void bench(uthread_run_attr_t *attr, const char *name,
+				  uthread_func_t func, unsigned long expected)
+{
+	unsigned long long start;
+
+	counter = 0;
+	start = now_ns();
+	if (uthread_run_attr(attr, func, NULL) == -1)
+	{
+		fprintf(stderr, "uthread_run_attr failed\n");
+		exit(1);
+	}
+
+	printf("%-5s %-11s %6.1f ns per lock (counter %s)\n",
+		   use_sem ? "sem" : "mutex", name,
+		   (double)(now_ns() - start) / expected,
+		   counter == expected ? "ok" : "wrong");
+}
+
+int main(int argc, char **argv)
+{
+	uthread_run_attr_t attr;
+
+	uthread_run_attr_init(&attr);
+	if (argc > 1)
+		iterations = get_argv(argv[1]);
+	if (argc > 2)
+		threads = get_argv(argv[2]);
+	if (argc > 3)
+		attr.workers = get_argv(argv[3]);
+	per_thread = iterations / threads;
+
+	sem = sem_create(1);
+
+	for (int i = 0; i < 2; i++)
+	{
+		use_sem = i == 1;
+		bench(&attr, "uncontended", uncontended, iterations);
+		bench(&attr, "contended", contended,
+			  (unsigned long)per_thread * threads);
+	}
+
+	sem_destroy(sem);
+
+	return 0;
+}
@@ -0,0 +1,139 @@
+/*
+ * Offloading benchmark
+ *
+ * Threads make a blocking call (a 10ms usleep(), standing for getaddrinfo() or
+ * a blocking library), either directly or through uthread_offload(), while
+ * another thread counts how many times it gets to run in the meantime. The
+ * elapsed time and that count are printed for both. Exits with status 1 if an
+ * offload fails, a call doesn't return, or the other thread didn't get to run
+ * more while calls were offloaded than while they blocked.
+ *
+ * Arguments: number of blocking calls, number of helpers.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <io.h>
+#include <uthread.h>
+
+#define CALLS 100
+#define CALL_US 10000
+
+static unsigned int calls = CALLS;
+static unsigned int remaining;
+static unsigned long long ticks;
+static unsigned int failures;
+static bool offload;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void blocking_call(void *arg)
+{
+	(void)arg;
+	usleep(CALL_US);
+}
+
+static void caller(void *arg)
+{
+	if (offload)
+	{
+		if (uthread_offload(blocking_call, arg) == -1)
+		{
+			fprintf(stderr, "uthread_offload failed\n");
+			failures++;
+		}
+	}
+	else
+		blocking_call(arg);
+
+	remaining--;
+}
+
+/* Runs whenever it can until every call returned */
+static void ticker(void *arg)
+{
+	(void)arg;
+
+	while (remaining > 0)
+	{
+		ticks++;
+		uthread_yield();
+	}
+}
+
+static void bench(void *arg)
+{
+	(void)arg;
+
+	remaining = calls;
+	ticks = 0;
+	uthread_create(ticker, NULL);
+	for (unsigned int i = 0; i < calls; i++)
+		uthread_create(caller, NULL);
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+	if (ret == LONG_MIN || ret == LONG_MAX)
+	{
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	uthread_run_attr_t attr;
+	unsigned long long direct_ticks = 0;
+
+	uthread_run_attr_init(&attr);
+	if (argc > 1)
+		calls = get_argv(argv[1]);
+	if (argc > 2)
+		attr.helpers = get_argv(argv[2]);
+
+	for (int i = 0; i < 2; i++)
+	{
+		unsigned long long start = now_ns();
+
+		offload = i == 1;
+		if (uthread_run_attr(&attr, bench, NULL) == -1)
+		{
+			fprintf(stderr, "uthread_run_attr failed\n");
+			return 1;
+		}
+
+		printf("%-8s %7.1f ms, other thread ran %llu times\n",
+			   offload ? "offload" : "direct", (now_ns() - start) / 1e6,
+			   ticks);
+
+		if (remaining != 0)
+		{
+			fprintf(stderr, "%u calls didn't return\n", remaining);
+			return 1;
+		}
+		if (!offload)
+			direct_ticks = ticks;
+	}
+
+	if (ticks <= direct_ticks)
+	{
+		fprintf(stderr, "offloading didn't let the other thread run\n");
+		return 1;
+	}
+
+	return failures != 0;
+}
@@ -0,0 +1,191 @@
+/*
+ * Park benchmark
+ *
+ * Threads increment counters picked at random among many, each protected by
+ * its own lock, and yield while holding it so that locks are contended. The
+ * locks are either single words built on uthread_park()/uthread_unpark(), or
+ * semaphores created with sem_create(). The time to set the locks up, the
+ * memory they take, and the number of increments per second are printed.
+ *
+ * Arguments: number of counters, number of threads, number of increments per
+ * thread, number of workers.
+ */
+
+#include <limits.h>
+#include <malloc.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <park.h>
+#include <sem.h>
+#include <uthread.h>
+
+#define COUNTERS 1000000
+#define THREADS 1000
+#define INCREMENTS 1000
+
+/* States of a word lock */
+#define UNLOCKED 0
+#define LOCKED 1
+#define CONTENDED 2
+
+static unsigned int counters = COUNTERS;
+static unsigned int threads = THREADS;
+static unsigned int increments = INCREMENTS;
+static bool use_sem;
+
+static unsigned int *words;
+static sem_t *sems;
+static unsigned long *values;
+
+/* Bytes allocated, including large blocks mapped on their own */
+static size_t allocated(void)
+{
+	struct mallinfo2 info = mallinfo2();
+
+	return info.uordblks + info.hblkhd;
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void word_lock(unsigned int *word)
+{
+	unsigned int state = UNLOCKED;
+
+	if (__atomic_compare_exchange_n(word, &state, LOCKED, false,
+									__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return;
+
+	// once contended, the lock stays so until it's free, not to miss waiters
+	while (__atomic_exchange_n(word, CONTENDED, __ATOMIC_ACQUIRE) != UNLOCKED)
+		uthread_park(word, CONTENDED);
+}
+
+static void word_unlock(unsigned int *word)
+{
+	if (__atomic_exchange_n(word, UNLOCKED, __ATOMIC_RELEASE) == CONTENDED)
+		uthread_unpark(word, 1);
+}
+
+static void worker(void *arg)
+{
+	unsigned int seed = (unsigned int)(unsigned long)arg;
+
+	for (unsigned int i = 0; i < increments; i++)
+	{
+		unsigned int n = rand_r(&seed) % counters;
+
+		if (use_sem)
+			sem_down(sems[n]);
+		else
+			word_lock(&words[n]);
+
+		unsigned long value = values[n];
+		uthread_yield();
+		values[n] = value + 1;
+
+		if (use_sem)
+			sem_up(sems[n]);
+		else
+			word_unlock(&words[n]);
+	}
+}
+
+static void spawn(void *arg)
+{
+	(void)arg;
+
+	for (unsigned int i = 0; i < threads; i++)
+		uthread_create(worker, (void *)(unsigned long)(i + 1));
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+	if (ret == LONG_MIN || ret == LONG_MAX)
+	{
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	uthread_run_attr_t attr;
+
+	uthread_run_attr_init(&attr);
+	if (argc > 1)
+		counters = get_argv(argv[1]);
+	if (argc > 2)
+		threads = get_argv(argv[2]);
+	if (argc > 3)
+		increments = get_argv(argv[3]);
+	if (argc > 4)
+		attr.workers = get_argv(argv[4]);
+	if (counters == 0)
+		counters = COUNTERS;
+
+	for (int i = 0; i < 2; i++)
+	{
+		unsigned long long start, setup;
+		size_t before, after;
+		unsigned long total = 0;
+
+		use_sem = i == 1;
+		values = calloc(counters, sizeof(*values));
+
+		before = allocated();
+		start = now_ns();
+		if (use_sem)
+		{
+			sems = malloc(counters * sizeof(*sems));
+			for (unsigned int j = 0; j < counters; j++)
+				sems[j] = sem_create(1);
+		}
+		else
+		{
+			words = calloc(counters, sizeof(*words));
+		}
+		setup = now_ns() - start;
+		after = allocated();
+
+		start = now_ns();
+		if (uthread_run_attr(&attr, spawn, NULL) == -1)
+		{
+			fprintf(stderr, "uthread_run_attr failed\n");
+			return 1;
+		}
+
+		for (unsigned int j = 0; j < counters; j++)
+			total += values[j];
+
+		printf("%-4s setup %7.2f ms, %6.1f MB, %5.2f M increments/s (%s)\n",
+			   use_sem ? "sem" : "park", setup / 1e6,
+			   (after - before) / 1e6,
+			   total / ((now_ns() - start) / 1e3),
+			   total == (unsigned long)threads * increments ? "ok" : "wrong");
+
+		if (use_sem)
+		{
+			for (unsigned int j = 0; j < counters; j++)
+				sem_destroy(sems[j]);
+			free(sems);
+		}
+		else
+		{
+			free(words);
+		}
+		free(values);
+	}
+
+	return 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * Preemption latency benchmark
+ *
+ * Threads spin without ever yielding while a probe thread repeatedly yields
+ * and measures how long it takes to get the CPU back. That delay is bounded by
+ * the preemption quantum times the number of spinners with FIFO scheduling,
+ * while MLFQ quickly demotes the spinners below the probe.
+ *
+ * Arguments: quantum (us), clock (0: virtual, 1: monotonic, 2: thread CPU
+ * time), number of spinners, scheduling policy (0: FIFO, 1: MLFQ).
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <uthread.h>
+
+#define PROBES 200
+
+static volatile int probing = 1;
+static unsigned int spinners = 1;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void spinner(void *arg)
+{
+	(void)arg;
+
+	while (probing)
+		;
+}
+
+static void probe(void *arg)
+{
+	unsigned long long total = 0, max = 0;
+	(void)arg;
+
+	for (unsigned int i = 0; i < spinners; i++)
+		uthread_create(spinner, NULL);
+
+	for (int i = 0; i < PROBES; i++)
+	{
+		unsigned long long start = now_ns(), delay;
+
+		uthread_yield();
+		delay = now_ns() - start;
+		total += delay;
+		if (delay > max)
+			max = delay;
+	}
+	probing = 0;
+
+	printf("wait for the CPU: avg %.0f us, max %.0f us\n",
+		   total / 1e3 / PROBES, max / 1e3);
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+	if (ret == LONG_MIN || ret == LONG_MAX)
+	{
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	uthread_run_attr_t attr;
+
+	uthread_run_attr_init(&attr);
+	attr.preempt = true;
+	if (argc > 1)
+		attr.quantum_us = get_argv(argv[1]);
+	if (argc > 2)
+		attr.clock = get_argv(argv[2]);
+	if (argc > 3)
+		spinners = get_argv(argv[3]);
+	if (argc > 4)
+		attr.sched = get_argv(argv[4]);
+
+	if (uthread_run_attr(&attr, probe, NULL) == -1)
+	{
+		fprintf(stderr, "uthread_run_attr failed\n");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,199 @@
+/*
+ * Reader-writer lock benchmark
+ *
+ * Reader threads look a table up under a lock, and each lookup takes a while
+ * (it sleeps 100us with the lock held, as if it waited for I/O). A writer
+ * updates the whole table every millisecond. The table is protected with a
+ * reader-writer lock (with and without writer preference), a mutex, or a
+ * semaphore created with a count of 1. The read throughput is printed for
+ * increasing numbers of readers, and the readers check that they never see a
+ * half-updated table.
+ *
+ * Arguments: number of lookups per reader, number of workers.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <mutex.h>
+#include <rwlock.h>
+#include <sem.h>
+#include <uthread.h>
+
+#define LOOKUPS 50
+#define TABLE_SIZE 64
+#define LOOKUP_NS 100000ULL
+#define WRITE_EVERY_NS 1000000ULL
+
+enum lock
+{
+	LOCK_RWLOCK,
+	LOCK_RWLOCK_WRITER,
+	LOCK_MUTEX,
+	LOCK_SEM,
+};
+
+static const char *const lock_names[] = {"rwlock", "rwlock (writer pref.)",
+										 "mutex", "sem"};
+
+static unsigned int lookups = LOOKUPS;
+static unsigned int readers;
+static enum lock lock;
+
+static uthread_rwlock_t rwlock;
+static uthread_mutex_t mutex = UTHREAD_MUTEX_INITIALIZER;
+static sem_t sem;
+
+static unsigned int table[TABLE_SIZE];
+static unsigned int readers_left;
+static unsigned int writes, torn_reads;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void lock_read(void)
+{
+	switch (lock)
+	{
+	case LOCK_RWLOCK:
+	case LOCK_RWLOCK_WRITER:
+		uthread_rwlock_rdlock(&rwlock);
+		break;
+	case LOCK_MUTEX:
+		uthread_mutex_lock(&mutex);
+		break;
+	case LOCK_SEM:
+		sem_down(sem);
+		break;
+	}
+}
+
+static void lock_write(void)
+{
+	if (lock == LOCK_RWLOCK || lock == LOCK_RWLOCK_WRITER)
+		uthread_rwlock_wrlock(&rwlock);
+	else
+		lock_read();
+}
+
+static void unlock(void)
+{
+	switch (lock)
+	{
+	case LOCK_RWLOCK:
+	case LOCK_RWLOCK_WRITER:
+		uthread_rwlock_unlock(&rwlock);
+		break;
+	case LOCK_MUTEX:
+		uthread_mutex_unlock(&mutex);
+		break;
+	case LOCK_SEM:
+		sem_up(sem);
+		break;
+	}
+}
+
+static void reader(void *arg)
+{
+	(void)arg;
+
+	for (unsigned int i = 0; i < lookups; i++)
+	{
+		lock_read();
+		unsigned int first = table[0];
+		uthread_sleep_ns(LOOKUP_NS);
+		if (table[TABLE_SIZE - 1] != first)
+			__atomic_add_fetch(&torn_reads, 1, __ATOMIC_RELAXED);
+		unlock();
+	}
+
+	__atomic_sub_fetch(&readers_left, 1, __ATOMIC_RELAXED);
+}
+
+static void writer(void *arg)
+{
+	(void)arg;
+
+	while (__atomic_load_n(&readers_left, __ATOMIC_RELAXED) > 0)
+	{
+		lock_write();
+		for (unsigned int i = 0; i < TABLE_SIZE; i++)
+			table[i]++;
+		writes++;
+		unlock();
+		uthread_sleep_ns(WRITE_EVERY_NS);
+	}
+}
+
+static void bench(void *arg)
+{
+	(void)arg;
+
+	readers_left = readers;
+	for (unsigned int i = 0; i < readers; i++)
+		uthread_create(reader, NULL);
+	uthread_create(writer, NULL);
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+	if (ret == LONG_MIN || ret == LONG_MAX)
+	{
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	static const unsigned int reader_counts[] = {1, 4, 16, 64};
+	uthread_run_attr_t attr;
+
+	uthread_run_attr_init(&attr);
+	if (argc > 1)
+		lookups = get_argv(argv[1]);
+	if (argc > 2)
+		attr.workers = get_argv(argv[2]);
+
+	sem = sem_create(1);
+
+	for (lock = LOCK_RWLOCK; lock <= LOCK_SEM; lock++)
+	{
+		uthread_rwlock_init(&rwlock, lock == LOCK_RWLOCK_WRITER);
+
+		for (size_t i = 0; i < sizeof(reader_counts) / sizeof(reader_counts[0]);
+			 i++)
+		{
+			unsigned long long start;
+
+			readers = reader_counts[i];
+			writes = torn_reads = 0;
+
+			start = now_ns();
+			if (uthread_run_attr(&attr, bench, NULL) == -1)
+			{
+				fprintf(stderr, "uthread_run_attr failed\n");
+				return 1;
+			}
+
+			printf("%-21s %2u readers: %8.0f lookups/s, %4u writes%s\n",
+				   lock_names[lock], readers,
+				   (double)readers * lookups / ((now_ns() - start) / 1e9),
+				   writes, torn_reads ? ", torn reads!" : "");
+		}
+	}
+
+	sem_destroy(sem);
+
+	return 0;
+}
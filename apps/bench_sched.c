@@ -0,0 +1,267 @@
+/*
+ * Scheduling policy benchmark harness
+ *
+ * The same workloads are run under every built-in scheduling policy, plus a
+ * custom one (random picks) plugged in through uthread_sched_ops_t, with
+ * preemption enabled (1ms quantum):
+ * - pingpong: pairs of threads waking each other up through semaphores
+ * - fanout: a thread spawns short-lived threads and waits for all of them
+ * - mixed: CPU-bound threads next to an interactive one that only yields,
+ *   whose average wait for the CPU is reported
+ *
+ * Argument: number of pingpong rounds.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define PAIRS 4
+#define ROUNDS 100000
+#define FANOUT 10000
+#define SPINNERS 2
+#define SPIN_NS 200000000ULL
+#define PROBES 100
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Custom policy: pick a random ready thread
+ */
+static uthread_t *random_ready;
+static unsigned int random_len, random_cap, random_threads;
+
+static void random_fini(void)
+{
+	free(random_ready);
+	random_ready = NULL;
+	random_len = random_cap = random_threads = 0;
+}
+
+static int random_on_create(uthread_t thread, const uthread_attr_t *attr)
+{
+	(void)thread;
+	(void)attr;
+
+	if (random_threads == random_cap)
+	{
+		unsigned int cap = random_cap ? random_cap * 2 : 64;
+		uthread_t *ready = realloc(random_ready, cap * sizeof(uthread_t));
+
+		if (ready == NULL)
+			return -1;
+		random_ready = ready;
+		random_cap = cap;
+	}
+	random_threads++;
+	return 0;
+}
+
+static void random_on_exit(uthread_t thread)
+{
+	(void)thread;
+	random_threads--;
+}
+
+static void random_enqueue_ready(uthread_t thread)
+{
+	random_ready[random_len++] = thread;
+}
+
+static uthread_t random_pick_next(void)
+{
+	if (random_len == 0)
+		return NULL;
+
+	unsigned int i = rand() % random_len;
+	uthread_t thread = random_ready[i];
+
+	random_ready[i] = random_ready[--random_len];
+	return thread;
+}
+
+static const uthread_sched_ops_t random_ops = {
+	.fini = random_fini,
+	.on_create = random_on_create,
+	.enqueue_ready = random_enqueue_ready,
+	.pick_next = random_pick_next,
+	.on_exit = random_on_exit,
+};
+
+/*
+ * Workloads
+ */
+static unsigned int rounds = ROUNDS;
+
+struct pair
+{
+	sem_t ping;
+	sem_t pong;
+};
+
+static void pong(void *arg)
+{
+	struct pair *p = (struct pair *)arg;
+
+	for (unsigned int i = 0; i < rounds; i++)
+	{
+		sem_down(p->ping);
+		sem_up(p->pong);
+	}
+}
+
+static void ping(void *arg)
+{
+	struct pair *p = (struct pair *)arg;
+
+	uthread_create(pong, p);
+	for (unsigned int i = 0; i < rounds; i++)
+	{
+		sem_up(p->ping);
+		sem_down(p->pong);
+	}
+}
+
+static void pingpong(void *arg)
+{
+	struct pair *pairs = (struct pair *)arg;
+
+	for (int i = 0; i < PAIRS; i++)
+		uthread_create(ping, &pairs[i]);
+}
+
+static void fanout_child(void *arg)
+{
+	sem_up((sem_t)arg);
+}
+
+static void fanout(void *arg)
+{
+	sem_t done = sem_create(0);
+	(void)arg;
+
+	for (int i = 0; i < FANOUT; i++)
+		uthread_create(fanout_child, done);
+	for (int i = 0; i < FANOUT; i++)
+		sem_down(done);
+
+	sem_destroy(done);
+}
+
+static unsigned long long mixed_wait;
+
+static void spinner(void *arg)
+{
+	unsigned long long end = now_ns() + SPIN_NS;
+	(void)arg;
+
+	while (now_ns() < end)
+		;
+}
+
+static void mixed(void *arg)
+{
+	unsigned long long total = 0;
+	(void)arg;
+
+	for (int i = 0; i < SPINNERS; i++)
+		uthread_create(spinner, NULL);
+
+	for (int i = 0; i < PROBES; i++)
+	{
+		unsigned long long start = now_ns();
+
+		uthread_yield();
+		total += now_ns() - start;
+	}
+	mixed_wait = total / PROBES;
+}
+
+static double run_ms(uthread_run_attr_t *attr, uthread_func_t func, void *arg)
+{
+	unsigned long long start = now_ns();
+
+	if (uthread_run_attr(attr, func, arg) == -1)
+	{
+		fprintf(stderr, "uthread_run_attr failed\n");
+		exit(1);
+	}
+
+	return (now_ns() - start) / 1e6;
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+	if (ret == LONG_MIN || ret == LONG_MAX)
+	{
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	static const struct
+	{
+		const char *name;
+		uthread_sched_t sched;
+		const uthread_sched_ops_t *ops;
+	} policies[] = {
+		{"fifo", UTHREAD_SCHED_FIFO, NULL},
+		{"lifo", UTHREAD_SCHED_LIFO, NULL},
+		{"mlfq", UTHREAD_SCHED_MLFQ, NULL},
+		{"fair", UTHREAD_SCHED_FAIR, NULL},
+		{"random", UTHREAD_SCHED_FIFO, &random_ops},
+	};
+	struct pair pairs[PAIRS];
+
+	if (argc > 1)
+		rounds = get_argv(argv[1]);
+
+	for (int i = 0; i < PAIRS; i++)
+	{
+		pairs[i].ping = sem_create(0);
+		pairs[i].pong = sem_create(0);
+	}
+
+	printf("policy   pingpong (ms)  fanout (ms)  mixed wait (us)\n");
+	for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+	{
+		uthread_run_attr_t attr;
+		double pingpong_ms, fanout_ms;
+
+		uthread_run_attr_init(&attr);
+		attr.preempt = true;
+		attr.quantum_us = 1000;
+		attr.clock = UTHREAD_CLOCK_MONOTONIC;
+		attr.sched = policies[i].sched;
+		attr.sched_ops = policies[i].ops;
+
+		pingpong_ms = run_ms(&attr, pingpong, pairs);
+		fanout_ms = run_ms(&attr, fanout, NULL);
+		run_ms(&attr, mixed, NULL);
+
+		printf("%-8s %13.1f  %11.1f  %15.1f\n", policies[i].name, pingpong_ms,
+			   fanout_ms, mixed_wait / 1e3);
+	}
+
+	for (int i = 0; i < PAIRS; i++)
+	{
+		sem_destroy(pairs[i].ping);
+		sem_destroy(pairs[i].pong);
+	}
+
+	return 0;
+}
@@ -0,0 +1,180 @@
+/*
+ * Select benchmark
+ *
+ * A consumer takes messages from several producers, each sending on its own
+ * channel. It either waits on all the channels at once with uthread_select(),
+ * along with a semaphore telling it to stop once the producers are done, or
+ * fans the channels in: a helper thread per channel forwards its messages to a
+ * single merged channel, which is closed once the producers are done. The
+ * number of messages received per second is printed.
+ *
+ * Arguments: number of messages per producer, number of producers, number of
+ * workers.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <chan.h>
+#include <select.h>
+#include <sem.h>
+#include <uthread.h>
+
+#define MESSAGES 200000
+#define PRODUCERS 4
+#define MAX_PRODUCERS 64
+
+static unsigned int messages = MESSAGES;
+static unsigned int producers = PRODUCERS;
+static bool fan_in;
+
+static uthread_chan_t chans[MAX_PRODUCERS];
+static uthread_chan_t merged;
+static sem_t stop;
+static unsigned int producers_left, forwarders_left;
+static unsigned long received, sum;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void producer(void *arg)
+{
+	uthread_chan_t chan = arg;
+
+	for (unsigned int i = 1; i <= messages; i++)
+		uthread_chan_send(chan, &i);
+
+	if (fan_in)
+		uthread_chan_close(chan);
+	else if (__atomic_sub_fetch(&producers_left, 1, __ATOMIC_RELAXED) == 0)
+		sem_up(stop);
+}
+
+/* Forward the messages of a channel to the merged one */
+static void forwarder(void *arg)
+{
+	uthread_chan_t chan = arg;
+	unsigned int value;
+
+	while (uthread_chan_recv(chan, &value) == 0)
+		uthread_chan_send(merged, &value);
+
+	if (__atomic_sub_fetch(&forwarders_left, 1, __ATOMIC_RELAXED) == 0)
+		uthread_chan_close(merged);
+}
+
+static void consumer_select(void)
+{
+	uthread_select_case_t cases[MAX_PRODUCERS + 1];
+	unsigned int value;
+
+	cases[0].op = UTHREAD_SELECT_DOWN;
+	cases[0].sem = stop;
+	for (unsigned int i = 0; i < producers; i++)
+	{
+		cases[i + 1].op = UTHREAD_SELECT_RECV;
+		cases[i + 1].chan = chans[i];
+		cases[i + 1].msg = &value;
+	}
+
+	// the stop case comes first, but only fires once the producers are done
+	while (uthread_select(cases, producers + 1) != 0)
+	{
+		received++;
+		sum += value;
+	}
+}
+
+static void consumer_fan_in(void)
+{
+	unsigned int value;
+
+	forwarders_left = producers;
+	for (unsigned int i = 0; i < producers; i++)
+		uthread_create(forwarder, chans[i]);
+
+	while (uthread_chan_recv(merged, &value) == 0)
+	{
+		received++;
+		sum += value;
+	}
+}
+
+static void consumer(void *arg)
+{
+	(void)arg;
+
+	producers_left = producers;
+	for (unsigned int i = 0; i < producers; i++)
+		uthread_create(producer, chans[i]);
+
+	if (fan_in)
+		consumer_fan_in();
+	else
+		consumer_select();
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+	if (ret == LONG_MIN || ret == LONG_MAX)
+	{
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	uthread_run_attr_t attr;
+
+	uthread_run_attr_init(&attr);
+	if (argc > 1)
+		messages = get_argv(argv[1]);
+	if (argc > 2)
+		producers = get_argv(argv[2]);
+	if (argc > 3)
+		attr.workers = get_argv(argv[3]);
+	if (producers == 0 || producers > MAX_PRODUCERS)
+		producers = PRODUCERS;
+
+	for (int i = 0; i < 2; i++)
+	{
+		unsigned long long start;
+		unsigned long expected = (unsigned long)messages * (messages + 1) / 2;
+
+		fan_in = i == 1;
+		received = sum = 0;
+		for (unsigned int j = 0; j < producers; j++)
+			chans[j] = uthread_chan_create(sizeof(unsigned int), 0);
+		merged = uthread_chan_create(sizeof(unsigned int), 0);
+		stop = sem_create(0);
+
+		start = now_ns();
+		if (uthread_run_attr(&attr, consumer, NULL) == -1)
+		{
+			fprintf(stderr, "uthread_run_attr failed\n");
+			return 1;
+		}
+
+		printf("%-6s %5.2f M messages/s (%s)\n", fan_in ? "fan-in" : "select",
+			   received / ((now_ns() - start) / 1e3),
+			   sum == expected * producers ? "ok" : "wrong");
+
+		for (unsigned int j = 0; j < producers; j++)
+			uthread_chan_destroy(chans[j]);
+		uthread_chan_destroy(merged);
+		sem_destroy(stop);
+	}
+
+	return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ * Sleep benchmark
+ *
+ * Many threads each wait until a random time within a second (starting half a
+ * second from now, so that they're all created by then), either with
+ * uthread_sleep_until() or by spinning on uthread_yield() until the time comes.
+ * The average and worst lateness of the wake-ups are printed, along with the
+ * CPU time used. Exits with status 1 if a sleep fails, a thread wakes up before
+ * its time, or not every thread woke up.
+ *
+ * Arguments: number of threads (clamped to what the limit on memory mappings
+ * allows, as each stack takes two), number of workers.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include <uthread.h>
+
+#define THREADS 100000
+#define WINDOW_NS 1000000000ULL
+#define SETUP_NS 500000000ULL
+
+static unsigned int threads = THREADS;
+static bool spin;
+static unsigned long long start;
+static unsigned long long total_late, max_late;
+static unsigned int failures;
+static unsigned int woken;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double cpu_ms(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e3 +
+		   (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e3;
+}
+
+static void sleeper(void *arg)
+{
+	unsigned int seed = (unsigned int)(long)arg;
+	unsigned long long deadline = start + rand_r(&seed) % WINDOW_NS;
+
+	if (spin)
+	{
+		while (now_ns() < deadline)
+			uthread_yield();
+	}
+	else if (uthread_sleep_until(deadline) == -1)
+		__atomic_add_fetch(&failures, 1, __ATOMIC_RELAXED);
+
+	unsigned long long now = now_ns();
+
+	if (now < deadline)
+	{
+		__atomic_add_fetch(&failures, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	__atomic_add_fetch(&woken, 1, __ATOMIC_RELAXED);
+
+	unsigned long long late = now - deadline;
+
+	__atomic_add_fetch(&total_late, late, __ATOMIC_RELAXED);
+	if (late > __atomic_load_n(&max_late, __ATOMIC_RELAXED))
+		__atomic_store_n(&max_late, late, __ATOMIC_RELAXED);
+}
+
+static void bench(void *arg)
+{
+	uthread_attr_t attr;
+	(void)arg;
+
+	uthread_attr_init(&attr);
+	attr.stack_size = UTHREAD_STACK_MIN;
+
+	start = now_ns() + SETUP_NS;
+	for (unsigned int i = 0; i < threads; i++)
+	{
+		if (uthread_create_attr(&attr, sleeper, (void *)(long)(i + 1)) == -1)
+		{
+			fprintf(stderr, "uthread_create_attr failed\n");
+			exit(1);
+		}
+	}
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+	if (ret == LONG_MIN || ret == LONG_MAX)
+	{
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	uthread_run_attr_t attr;
+	unsigned int max_maps = 65530;
+	FILE *f;
+
+	uthread_run_attr_init(&attr);
+	if (argc > 1)
+		threads = get_argv(argv[1]);
+	if (argc > 2)
+		attr.workers = get_argv(argv[2]);
+
+	f = fopen("/proc/sys/vm/max_map_count", "r");
+	if (f != NULL)
+	{
+		if (fscanf(f, "%u", &max_maps) != 1)
+			max_maps = 65530;
+		fclose(f);
+	}
+	if (threads > (max_maps - 1024) / 2)
+	{
+		threads = (max_maps - 1024) / 2;
+		fprintf(stderr, "memory mapping limit: %u threads\n", threads);
+	}
+
+	for (int i = 0; i < 2; i++)
+	{
+		double cpu = cpu_ms();
+
+		spin = i == 1;
+		total_late = max_late = 0;
+		woken = 0;
+		if (uthread_run_attr(&attr, bench, NULL) == -1)
+		{
+			fprintf(stderr, "uthread_run_attr failed\n");
+			return 1;
+		}
+
+		printf("%-6s late by %8.1f us on average, %8.1f us at most, "
+			   "%7.1f ms of CPU\n",
+			   spin ? "spin" : "sleep", total_late / 1e3 / threads,
+			   max_late / 1e3, cpu_ms() - cpu);
+
+		if (woken != threads)
+		{
+			fprintf(stderr, "%u threads woke up on time\n", woken);
+			return 1;
+		}
+	}
+
+	return failures != 0;
+}
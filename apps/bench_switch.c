@@ -0,0 +1,136 @@
+/*
+ * Context switch latency benchmark
+ *
+ * Two threads ping-pong the CPU between each other, first by simply yielding
+ * and then through a pair of semaphores (the same pattern as sem_buffer and
+ * sem_prime). The average cost of a single switch is printed in nanoseconds.
+ *
+ * Optionally, a number of extra threads stay blocked on a semaphore for the
+ * whole benchmark, which shouldn't make any difference.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define ITERATIONS 1000000
+
+struct pingpong
+{
+	sem_t ping;
+	sem_t pong;
+	sem_t park;
+	size_t iterations;
+	size_t parked;
+};
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void yield_partner(void *arg)
+{
+	struct pingpong *p = (struct pingpong *)arg;
+
+	for (size_t i = 0; i < p->iterations; i++)
+		uthread_yield();
+}
+
+static void sem_partner(void *arg)
+{
+	struct pingpong *p = (struct pingpong *)arg;
+
+	for (size_t i = 0; i < p->iterations; i++)
+	{
+		sem_down(p->ping);
+		sem_up(p->pong);
+	}
+}
+
+static void parked(void *arg)
+{
+	struct pingpong *p = (struct pingpong *)arg;
+
+	sem_down(p->park);
+}
+
+static void bench(void *arg)
+{
+	struct pingpong *p = (struct pingpong *)arg;
+	unsigned long long start, end;
+
+	for (size_t i = 0; i < p->parked; i++)
+		uthread_create(parked, p);
+
+	/* Let them all block */
+	uthread_yield();
+
+	/* Each iteration is two switches: to the partner and back */
+	uthread_create(yield_partner, p);
+	start = now_ns();
+	for (size_t i = 0; i < p->iterations; i++)
+		uthread_yield();
+	end = now_ns();
+	printf("yield:    %.1f ns/switch\n",
+		   (double)(end - start) / (2 * p->iterations));
+
+	/* Let the partner finish before starting the next round */
+	uthread_yield();
+
+	uthread_create(sem_partner, p);
+	start = now_ns();
+	for (size_t i = 0; i < p->iterations; i++)
+	{
+		sem_up(p->ping);
+		sem_down(p->pong);
+	}
+	end = now_ns();
+	printf("sem:      %.1f ns/switch\n",
+		   (double)(end - start) / (2 * p->iterations));
+
+	for (size_t i = 0; i < p->parked; i++)
+		sem_up(p->park);
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+	if (ret == LONG_MIN || ret == LONG_MAX)
+	{
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	struct pingpong p;
+
+	p.iterations = ITERATIONS;
+	p.parked = 0;
+	if (argc > 1)
+		p.iterations = get_argv(argv[1]);
+	if (argc > 2)
+		p.parked = get_argv(argv[2]);
+
+	p.ping = sem_create(0);
+	p.pong = sem_create(0);
+	p.park = sem_create(0);
+
+	uthread_run(false, bench, &p);
+
+	sem_destroy(p.ping);
+	sem_destroy(p.pong);
+	sem_destroy(p.park);
+
+	return 0;
+}
@@ -0,0 +1,212 @@
+/*
+ * Channel tester
+ *
+ * Check the single-threaded semantics of channels (buffering, closing,
+ * destroying), then have senders and receivers go through a channel until the
+ * last sender closes it, with capacities 0, 1 and 16, with 1, 2 and 4 workers,
+ * with and without preemption. Every message must be received exactly once,
+ * and the receivers blocked when the channel is closed must be woken up. Exits
+ * with status 1 as soon as a check fails.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <chan.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define SENDERS 4
+#define RECEIVERS 5
+#define MESSAGES 50000
+
+static uthread_chan_t chan;
+static unsigned int senders_left;
+static unsigned long received, sum;
+static int results[8];
+
+void test_null(void)
+{
+	fprintf(stderr, "*** TEST null ***\n");
+
+	int value = 0;
+
+	TEST_ASSERT(uthread_chan_create(0, 1) == NULL);
+	TEST_ASSERT(uthread_chan_create(SIZE_MAX / 2, 4) == NULL);
+	TEST_ASSERT(uthread_chan_destroy(NULL) == -1);
+	TEST_ASSERT(uthread_chan_send(NULL, &value) == -1);
+	TEST_ASSERT(uthread_chan_recv(NULL, &value) == -1);
+	TEST_ASSERT(uthread_chan_close(NULL) == -1);
+
+	chan = uthread_chan_create(sizeof(int), 1);
+	TEST_ASSERT(uthread_chan_send(chan, NULL) == -1);
+	TEST_ASSERT(uthread_chan_recv(chan, NULL) == -1);
+	TEST_ASSERT(uthread_chan_destroy(chan) == 0);
+}
+
+static void buffered(void *arg)
+{
+	int value;
+
+	(void)arg;
+
+	// fits in the buffer without a receiver
+	value = 1;
+	results[0] = uthread_chan_send(chan, &value);
+	value = 2;
+	results[1] = uthread_chan_send(chan, &value);
+
+	results[2] = uthread_chan_close(chan);
+	results[3] = uthread_chan_close(chan);
+	results[4] = uthread_chan_send(chan, &value);
+
+	// buffered messages are still received once closed
+	uthread_chan_recv(chan, &value);
+	results[5] = value;
+	uthread_chan_recv(chan, &value);
+	results[6] = value;
+	results[7] = uthread_chan_recv(chan, &value);
+}
+
+void test_close(void)
+{
+	fprintf(stderr, "*** TEST close ***\n");
+
+	chan = uthread_chan_create(sizeof(int), 2);
+	uthread_run(false, buffered, NULL);
+
+	TEST_ASSERT(results[0] == 0 && results[1] == 0);
+	TEST_ASSERT(results[2] == 0);
+	TEST_ASSERT(results[3] == -1);
+	TEST_ASSERT(results[4] == UTHREAD_CHAN_CLOSED);
+	TEST_ASSERT(results[5] == 1 && results[6] == 2);
+	TEST_ASSERT(results[7] == UTHREAD_CHAN_CLOSED);
+	TEST_ASSERT(uthread_chan_destroy(chan) == 0);
+}
+
+static void blocked(void *arg)
+{
+	int value;
+
+	(void)arg;
+
+	results[0] = uthread_chan_recv(chan, &value);
+}
+
+static void destroyer(void *arg)
+{
+	(void)arg;
+
+	uthread_create(blocked, NULL);
+	uthread_yield();
+
+	// the receiver is still blocked
+	results[1] = uthread_chan_destroy(chan);
+	uthread_chan_close(chan);
+}
+
+void test_destroy(void)
+{
+	fprintf(stderr, "*** TEST destroy ***\n");
+
+	chan = uthread_chan_create(sizeof(int), 0);
+	uthread_run(false, destroyer, NULL);
+
+	TEST_ASSERT(results[1] == -1);
+	TEST_ASSERT(results[0] == UTHREAD_CHAN_CLOSED);
+	TEST_ASSERT(uthread_chan_destroy(chan) == 0);
+}
+
+static void sender(void *arg)
+{
+	unsigned long base = (unsigned long)arg * MESSAGES;
+
+	for (unsigned long i = 0; i < MESSAGES; i++)
+	{
+		unsigned long value = base + i;
+
+		if (uthread_chan_send(chan, &value) != 0)
+			break;
+		if (i % 9 == 0)
+			uthread_yield();
+	}
+
+	if (__atomic_sub_fetch(&senders_left, 1, __ATOMIC_RELAXED) == 0)
+		uthread_chan_close(chan);
+}
+
+static void receiver(void *arg)
+{
+	unsigned long value;
+
+	(void)arg;
+
+	while (uthread_chan_recv(chan, &value) == 0)
+	{
+		__atomic_add_fetch(&received, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&sum, value, __ATOMIC_RELAXED);
+	}
+}
+
+static void spawn(void *arg)
+{
+	(void)arg;
+
+	senders_left = SENDERS;
+	for (unsigned long i = 0; i < SENDERS; i++)
+		uthread_create(sender, (void *)i);
+	for (int i = 0; i < RECEIVERS; i++)
+		uthread_create(receiver, NULL);
+}
+
+void test_stress(size_t capacity, unsigned int workers, bool preempt)
+{
+	unsigned long total = (unsigned long)SENDERS * MESSAGES;
+
+	fprintf(stderr, "*** TEST stress (capacity %zu, %u workers, %s) ***\n",
+			capacity, workers, preempt ? "preemptive" : "cooperative");
+
+	chan = uthread_chan_create(sizeof(unsigned long), capacity);
+	received = sum = 0;
+
+	TEST_ASSERT(uthread_run_mt(workers, preempt, spawn, NULL) == 0);
+	TEST_ASSERT(received == total);
+	TEST_ASSERT(sum == total * (total - 1) / 2);
+	TEST_ASSERT(uthread_chan_destroy(chan) == 0);
+}
+
+int main(void)
+{
+	static const size_t capacities[] = {0, 1, 16};
+
+	test_null();
+	test_close();
+	test_destroy();
+
+	for (int i = 0; i < 3; i++)
+	{
+		for (unsigned int workers = 1; workers <= 4; workers *= 2)
+		{
+			test_stress(capacities[i], workers, false);
+			test_stress(capacities[i], workers, true);
+		}
+	}
+
+	return 0;
+}
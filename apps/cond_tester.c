@@ -0,0 +1,146 @@
+/*
+ * Condition variable tester
+ *
+ * Producers and consumers go through a bounded buffer protected by a mutex,
+ * waiting on condition variables for room or for items. Producers wake
+ * consumers up with signals and broadcasts, consumers wake producers up with
+ * broadcasts. Runs under every scheduling policy with a single worker, then
+ * with 2 and 4 workers (FIFO only), with and without preemption, and exits
+ * with status 1 as soon as an item is lost or the buffer overflows.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <cond.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define PAIRS 8
+#define ITEMS 100000
+#define CAPACITY 4
+
+static const char *const policies[] = {"FIFO", "MLFQ", "fair", "LIFO"};
+
+static uthread_mutex_t mutex = UTHREAD_MUTEX_INITIALIZER;
+static uthread_cond_t not_empty = UTHREAD_COND_INITIALIZER;
+static uthread_cond_t not_full = UTHREAD_COND_INITIALIZER;
+static unsigned int items, overflows;
+static unsigned long produced, consumed;
+
+static void producer(void *arg)
+{
+	(void)arg;
+
+	for (unsigned long i = 1; i <= ITEMS; i++)
+	{
+		uthread_mutex_lock(&mutex);
+		while (items == CAPACITY)
+			uthread_cond_wait(&not_full, &mutex);
+
+		if (++items > CAPACITY)
+			overflows++;
+		produced += i;
+
+		if (i % 3)
+			uthread_cond_signal(&not_empty);
+		else
+			uthread_cond_broadcast(&not_empty);
+		uthread_mutex_unlock(&mutex);
+	}
+}
+
+static void consumer(void *arg)
+{
+	(void)arg;
+
+	for (unsigned long i = 1; i <= ITEMS; i++)
+	{
+		uthread_mutex_lock(&mutex);
+		while (items == 0)
+			uthread_cond_wait(&not_empty, &mutex);
+
+		items--;
+		consumed += i;
+
+		uthread_cond_broadcast(&not_full);
+		uthread_mutex_unlock(&mutex);
+	}
+}
+
+static void spawn(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < PAIRS; i++)
+	{
+		uthread_create(producer, NULL);
+		uthread_create(consumer, NULL);
+	}
+}
+
+void test_null(void)
+{
+	fprintf(stderr, "*** TEST null ***\n");
+
+	TEST_ASSERT(uthread_cond_init(NULL) == -1);
+	TEST_ASSERT(uthread_cond_wait(NULL, &mutex) == -1);
+	TEST_ASSERT(uthread_cond_wait(&not_empty, NULL) == -1);
+	TEST_ASSERT(uthread_cond_signal(NULL) == -1);
+	TEST_ASSERT(uthread_cond_broadcast(NULL) == -1);
+}
+
+void test_buffer(uthread_sched_t sched, unsigned int workers, bool preempt)
+{
+	uthread_run_attr_t attr;
+
+	fprintf(stderr, "*** TEST buffer (%s, %u workers, %s) ***\n",
+			policies[sched], workers, preempt ? "preemptive" : "cooperative");
+
+	uthread_run_attr_init(&attr);
+	attr.sched = sched;
+	attr.workers = workers;
+	attr.preempt = preempt;
+
+	items = overflows = 0;
+	produced = consumed = 0;
+	TEST_ASSERT(uthread_run_attr(&attr, spawn, NULL) == 0);
+	TEST_ASSERT(items == 0 && overflows == 0);
+	TEST_ASSERT(produced == consumed);
+}
+
+int main(void)
+{
+	test_null();
+
+	for (uthread_sched_t sched = UTHREAD_SCHED_FIFO; sched <= UTHREAD_SCHED_LIFO;
+		 sched++)
+	{
+		test_buffer(sched, 1, false);
+		test_buffer(sched, 1, true);
+	}
+
+	// only FIFO runs on several workers
+	for (unsigned int workers = 2; workers <= 4; workers *= 2)
+	{
+		test_buffer(UTHREAD_SCHED_FIFO, workers, false);
+		test_buffer(UTHREAD_SCHED_FIFO, workers, true);
+	}
+
+	return 0;
+}
@@ -0,0 +1,132 @@
+/*
+ * File tester
+ *
+ * Have more threads read a file with uthread_pread() at the same time than the
+ * io_uring completion queue holds, so that completions overflow it, and check
+ * that every read returns the block it asked for. Runs with io_uring and with
+ * helper kernel threads, on 1 and 4 workers. Exits with status 1 as soon as a
+ * read fails or the run doesn't finish.
+ */
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <io.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define FILE_NAME "file_tester.dat"
+#define BLOCKS 64
+#define BLOCK_SIZE 512
+#define THREADS 5000
+
+static int fd;
+static unsigned int done, failures;
+
+static void reader(void *arg)
+{
+	unsigned int block = (unsigned long)arg % BLOCKS;
+	char buf[BLOCK_SIZE];
+
+	if (uthread_pread(fd, buf, BLOCK_SIZE, (off_t)block * BLOCK_SIZE) !=
+			BLOCK_SIZE ||
+		buf[0] != (char)block || buf[BLOCK_SIZE - 1] != (char)block)
+		__atomic_add_fetch(&failures, 1, __ATOMIC_RELAXED);
+
+	__atomic_add_fetch(&done, 1, __ATOMIC_RELAXED);
+}
+
+static void spawn(void *arg)
+{
+	(void)arg;
+
+	for (unsigned long i = 0; i < THREADS; i++)
+		uthread_create(reader, (void *)i);
+}
+
+static int create_file(void)
+{
+	char buf[BLOCK_SIZE];
+	int out = open(FILE_NAME, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+
+	if (out == -1)
+		return -1;
+
+	for (int i = 0; i < BLOCKS; i++)
+	{
+		memset(buf, i, BLOCK_SIZE);
+		if (write(out, buf, BLOCK_SIZE) != BLOCK_SIZE)
+		{
+			close(out);
+			return -1;
+		}
+	}
+
+	return close(out);
+}
+
+void test_overflow(bool io_uring, unsigned int workers)
+{
+	uthread_run_attr_t attr;
+
+	fprintf(stderr, "*** TEST overflow (%s, %u workers) ***\n",
+			io_uring ? "io_uring" : "helpers", workers);
+
+	uthread_run_attr_init(&attr);
+	attr.io_uring = io_uring;
+	attr.workers = workers;
+	done = failures = 0;
+
+	// a lost completion hangs the run
+	alarm(60);
+	TEST_ASSERT(uthread_run_attr(&attr, spawn, NULL) == 0);
+	alarm(0);
+
+	TEST_ASSERT(done == THREADS);
+	TEST_ASSERT(failures == 0);
+}
+
+int main(void)
+{
+	if (create_file() == -1)
+	{
+		perror("create");
+		return 1;
+	}
+
+	fd = open(FILE_NAME, O_RDONLY);
+	unlink(FILE_NAME);
+	if (fd == -1)
+	{
+		perror("open");
+		return 1;
+	}
+
+	for (unsigned int workers = 1; workers <= 4; workers *= 4)
+	{
+		test_overflow(true, workers);
+		test_overflow(false, workers);
+	}
+
+	close(fd);
+
+	return 0;
+}
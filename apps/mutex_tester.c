@@ -0,0 +1,114 @@
+/*
+ * Mutex tester
+ *
+ * Check the single-threaded semantics of mutexes, then have threads increment
+ * a counter under a mutex, yielding in the middle of the increment, with 1, 2
+ * and 4 workers, with and without preemption. Exits with status 1 as soon as
+ * a check fails.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <mutex.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define THREADS 16
+#define INCREMENTS 100000
+
+static uthread_mutex_t mutex = UTHREAD_MUTEX_INITIALIZER;
+static unsigned long counter;
+static int trylock_held, trylock_free;
+
+static void trylock(void *arg)
+{
+	(void)arg;
+
+	uthread_mutex_lock(&mutex);
+	trylock_held = uthread_mutex_trylock(&mutex);
+	uthread_mutex_unlock(&mutex);
+	trylock_free = uthread_mutex_trylock(&mutex);
+	uthread_mutex_unlock(&mutex);
+}
+
+void test_null(void)
+{
+	fprintf(stderr, "*** TEST null ***\n");
+
+	TEST_ASSERT(uthread_mutex_init(NULL) == -1);
+	TEST_ASSERT(uthread_mutex_lock(NULL) == -1);
+	TEST_ASSERT(uthread_mutex_trylock(NULL) == -1);
+	TEST_ASSERT(uthread_mutex_unlock(NULL) == -1);
+}
+
+void test_trylock(void)
+{
+	fprintf(stderr, "*** TEST trylock ***\n");
+
+	uthread_run(false, trylock, NULL);
+	TEST_ASSERT(trylock_held == -1);
+	TEST_ASSERT(trylock_free == 0);
+}
+
+static void increment(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < INCREMENTS; i++)
+	{
+		uthread_mutex_lock(&mutex);
+		unsigned long value = counter;
+		if (i % 7 == 0)
+			uthread_yield();
+		counter = value + 1;
+		uthread_mutex_unlock(&mutex);
+	}
+}
+
+static void spawn(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < THREADS; i++)
+		uthread_create(increment, NULL);
+}
+
+void test_counter(unsigned int workers, bool preempt)
+{
+	fprintf(stderr, "*** TEST counter (%u workers, %s) ***\n", workers,
+			preempt ? "preemptive" : "cooperative");
+
+	counter = 0;
+	TEST_ASSERT(uthread_run_mt(workers, preempt, spawn, NULL) == 0);
+	TEST_ASSERT(counter == (unsigned long)THREADS * INCREMENTS);
+}
+
+int main(void)
+{
+	test_null();
+	test_trylock();
+
+	for (unsigned int workers = 1; workers <= 4; workers *= 2)
+	{
+		test_counter(workers, false);
+		test_counter(workers, true);
+	}
+
+	return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * Park tester
+ *
+ * Check the semantics of uthread_park() and uthread_unpark(): parking fails
+ * right away if the address doesn't hold the expected value, unparking wakes
+ * up at most the given number of threads, oldest first, and only those parked
+ * on that address. Then build a lock and a barrier out of single words, and
+ * have threads increment counters under the locks and meet at the barrier,
+ * with 1, 2 and 4 workers, with and without preemption. Exits with status 1 as
+ * soon as a check fails.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <park.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define PARKED 3
+#define THREADS 16
+#define LOCKS 4
+#define INCREMENTS 100000
+#define BARRIER_EVERY 1000
+
+/* States of a word lock */
+#define UNLOCKED 0
+#define LOCKED 1
+#define CONTENDED 2
+
+static unsigned int word, other_word;
+static int woken[PARKED + 1];
+static unsigned int nwoken;
+static int results[8];
+
+void test_null(void)
+{
+	fprintf(stderr, "*** TEST null ***\n");
+
+	TEST_ASSERT(uthread_park(NULL, 0) == -1);
+	TEST_ASSERT(uthread_unpark(NULL, 1) == -1);
+}
+
+static void parked(void *arg)
+{
+	unsigned int *addr = arg == NULL ? &other_word : &word;
+
+	uthread_park(addr, 0);
+	woken[nwoken++] = arg == NULL ? 0 : (int)(long)arg;
+}
+
+static void unparker(void *arg)
+{
+	(void)arg;
+
+	word = 1;
+	results[0] = uthread_park(&word, 0);
+	word = 0;
+
+	uthread_create(parked, NULL);
+	for (long i = 1; i <= PARKED; i++)
+		uthread_create(parked, (void *)i);
+	uthread_yield();
+
+	results[1] = uthread_unpark(&word, 1);
+	uthread_yield();
+	results[2] = nwoken;
+
+	results[3] = uthread_unpark(&word, PARKED);
+	uthread_yield();
+	results[4] = nwoken;
+
+	results[5] = uthread_unpark(&word, 1);
+	results[6] = uthread_unpark(&other_word, 1);
+}
+
+void test_unpark(void)
+{
+	fprintf(stderr, "*** TEST unpark ***\n");
+
+	uthread_run(false, unparker, NULL);
+
+	// the value changed before parking
+	TEST_ASSERT(results[0] == -1);
+
+	// one at a time, oldest first, and only on @word
+	TEST_ASSERT(results[1] == 1 && results[2] == 1 && woken[0] == 1);
+	TEST_ASSERT(results[3] == PARKED - 1 && results[4] == PARKED);
+	TEST_ASSERT(woken[1] == 2 && woken[2] == 3);
+	TEST_ASSERT(results[5] == 0);
+	TEST_ASSERT(results[6] == 1 && woken[3] == 0);
+}
+
+static unsigned int locks[LOCKS];
+static unsigned long counters[LOCKS];
+static unsigned int generation, arrived;
+
+static void word_lock(unsigned int *lock)
+{
+	unsigned int state = UNLOCKED;
+
+	if (__atomic_compare_exchange_n(lock, &state, LOCKED, false,
+									__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return;
+
+	while (__atomic_exchange_n(lock, CONTENDED, __ATOMIC_ACQUIRE) != UNLOCKED)
+		uthread_park(lock, CONTENDED);
+}
+
+static void word_unlock(unsigned int *lock)
+{
+	if (__atomic_exchange_n(lock, UNLOCKED, __ATOMIC_RELEASE) == CONTENDED)
+		uthread_unpark(lock, 1);
+}
+
+// The last thread to arrive starts a new generation and wakes everyone up
+static void barrier(void)
+{
+	unsigned int current = __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+
+	if (__atomic_add_fetch(&arrived, 1, __ATOMIC_ACQ_REL) == THREADS)
+	{
+		arrived = 0;
+		__atomic_add_fetch(&generation, 1, __ATOMIC_RELEASE);
+		uthread_unpark(&generation, THREADS);
+		return;
+	}
+
+	while (__atomic_load_n(&generation, __ATOMIC_ACQUIRE) == current)
+		uthread_park(&generation, current);
+}
+
+static void increment(void *arg)
+{
+	unsigned long id = (unsigned long)arg;
+
+	for (unsigned long i = 0; i < INCREMENTS; i++)
+	{
+		unsigned int n = (i + id) % LOCKS;
+
+		word_lock(&locks[n]);
+		unsigned long value = counters[n];
+		if (i % 7 == 0)
+			uthread_yield();
+		counters[n] = value + 1;
+		word_unlock(&locks[n]);
+
+		if (i % BARRIER_EVERY == 0)
+			barrier();
+	}
+}
+
+static void spawn(void *arg)
+{
+	(void)arg;
+
+	for (unsigned long i = 0; i < THREADS; i++)
+		uthread_create(increment, (void *)i);
+}
+
+void test_stress(unsigned int workers, bool preempt)
+{
+	unsigned long total = 0;
+
+	fprintf(stderr, "*** TEST stress (%u workers, %s) ***\n", workers,
+			preempt ? "preemptive" : "cooperative");
+
+	for (int i = 0; i < LOCKS; i++)
+		locks[i] = counters[i] = 0;
+	generation = arrived = 0;
+
+	TEST_ASSERT(uthread_run_mt(workers, preempt, spawn, NULL) == 0);
+
+	for (int i = 0; i < LOCKS; i++)
+		total += counters[i];
+	TEST_ASSERT(total == (unsigned long)THREADS * INCREMENTS);
+	TEST_ASSERT(generation == INCREMENTS / BARRIER_EVERY);
+}
+
+int main(void)
+{
+	test_null();
+	test_unpark();
+
+	for (unsigned int workers = 1; workers <= 4; workers *= 2)
+	{
+		test_stress(workers, false);
+		test_stress(workers, true);
+	}
+
+	return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * Queue benchmark
+ *
+ * Times the basic operations of the queue API on a large number of items:
+ * filling and draining a queue, cycling items through a queue of constant
+ * length (like a scheduler does), and iterating over a queue. The Makefile
+ * links this program against each queue implementation so that they can be
+ * compared (queue_bench_list.x and queue_bench_ring.x).
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <queue.h>
+
+#define ITEMS 10000
+#define ROUNDS 100
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned long sum;
+
+static void add(queue_t q, void *data)
+{
+	(void)q;
+
+	sum += *(int *)data;
+}
+
+static void report(const char *name, unsigned long long start, size_t ops)
+{
+	printf("%-10s %6.1f ns/op\n", name, (double)(now_ns() - start) / ops);
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+	if (ret == LONG_MIN || ret == LONG_MAX)
+	{
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	size_t items = ITEMS;
+	unsigned long long start;
+	int *data, *out;
+	queue_t q;
+
+	if (argc > 1)
+		items = get_argv(argv[1]);
+
+	data = malloc(items * sizeof(int));
+	for (size_t i = 0; i < items; i++)
+		data[i] = i;
+
+	/* Fill and drain, from a fresh queue every round */
+	start = now_ns();
+	for (size_t r = 0; r < ROUNDS; r++)
+	{
+		q = queue_create();
+		for (size_t i = 0; i < items; i++)
+			queue_enqueue(q, &data[i]);
+		for (size_t i = 0; i < items; i++)
+			queue_dequeue(q, (void **)&out);
+		queue_destroy(q);
+	}
+	report("fill/drain", start, ROUNDS * items * 2);
+
+	/* Same with preallocated storage */
+	start = now_ns();
+	for (size_t r = 0; r < ROUNDS; r++)
+	{
+		q = queue_create_capacity(items);
+		for (size_t i = 0; i < items; i++)
+			queue_enqueue(q, &data[i]);
+		for (size_t i = 0; i < items; i++)
+			queue_dequeue(q, (void **)&out);
+		queue_destroy(q);
+	}
+	report("prealloc", start, ROUNDS * items * 2);
+
+	/* Cycle items through a full queue */
+	q = queue_create();
+	for (size_t i = 0; i < items; i++)
+		queue_enqueue(q, &data[i]);
+	start = now_ns();
+	for (size_t i = 0; i < ROUNDS * items; i++)
+	{
+		queue_dequeue(q, (void **)&out);
+		queue_enqueue(q, out);
+	}
+	report("cycle", start, ROUNDS * items);
+
+	/* Iterate */
+	start = now_ns();
+	for (size_t r = 0; r < ROUNDS; r++)
+		queue_iterate(q, add);
+	report("iterate", start, ROUNDS * items);
+
+	for (size_t i = 0; i < items; i++)
+		queue_dequeue(q, (void **)&out);
+	queue_destroy(q);
+	free(data);
+
+	if (sum != ROUNDS * (items * (items - 1) / 2))
+	{
+		fprintf(stderr, "bad iteration sum\n");
+		return 1;
+	}
+
+	return 0;
+}
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <iqueue.h>
 #include <queue.h>
 
 #define TEST_ASSERT(assert)                 \
@@ -152,6 +153,58 @@ void test_iterator(void)
 	TEST_ASSERT(queue_iterate(NULL, iterator_inc) == -1);
 }
 
+static int visited;
+static int appended[3];
+
+void iterator_append(queue_t q, void *data)
+{
+	(void)data;
+
+	queue_enqueue(q, &appended[visited++]);
+}
+
+static int *tail;
+
+void iterator_replace_tail(queue_t q, void *data)
+{
+	(void)data;
+
+	// The recycled node of the tail holds the new item
+	if (visited++ == 0)
+	{
+		queue_delete(q, tail);
+		queue_enqueue(q, &appended[0]);
+	}
+}
+
+void test_iterator_enqueue(void)
+{
+	fprintf(stderr, "*** TEST iterator_enqueue ***\n");
+
+	queue_t q = queue_create();
+	int data[] = {1, 2, 3};
+
+	for (size_t i = 0; i < sizeof(data) / sizeof(data[0]); i++)
+		queue_enqueue(q, &data[i]);
+
+	// Items enqueued by the callback aren't visited
+	visited = 0;
+	TEST_ASSERT(queue_iterate(q, iterator_append) == 0);
+	TEST_ASSERT(visited == 3);
+	TEST_ASSERT(queue_length(q) == 6);
+
+	// Even in place of a deleted tail
+	q = queue_create();
+	for (size_t i = 0; i < sizeof(data) / sizeof(data[0]); i++)
+		queue_enqueue(q, &data[i]);
+	tail = &data[2];
+
+	visited = 0;
+	TEST_ASSERT(queue_iterate(q, iterator_replace_tail) == 0);
+	TEST_ASSERT(visited == 2);
+	TEST_ASSERT(queue_length(q) == 3);
+}
+
 void test_length(void)
 {
 	fprintf(stderr, "*** TEST length ***\n");
@@ -189,6 +242,46 @@ void test_queue_simple(void)
 	TEST_ASSERT(ptr == &data);
 }
 
+struct item
+{
+	int value;
+	struct iqueue_node node;
+};
+
+void test_iqueue(void)
+{
+	fprintf(stderr, "*** TEST iqueue ***\n");
+
+	struct iqueue q;
+	struct item items[5];
+
+	iqueue_init(&q);
+	TEST_ASSERT(iqueue_dequeue(&q) == NULL);
+
+	for (int i = 0; i < 5; i++)
+	{
+		items[i].value = i;
+		iqueue_node_init(&items[i].node);
+		iqueue_enqueue(&q, &items[i].node);
+	}
+	TEST_ASSERT(iqueue_length(&q) == 5);
+	TEST_ASSERT(iqueue_linked(&items[2].node));
+
+	// Delete from the middle, head and tail
+	iqueue_delete(&q, &items[2].node);
+	TEST_ASSERT(!iqueue_linked(&items[2].node));
+	iqueue_delete(&q, &items[0].node);
+	iqueue_delete(&q, &items[4].node);
+	TEST_ASSERT(iqueue_length(&q) == 2);
+
+	struct iqueue_node *node = iqueue_dequeue(&q);
+	TEST_ASSERT(iqueue_entry(node, struct item, node)->value == 1);
+	node = iqueue_dequeue(&q);
+	TEST_ASSERT(iqueue_entry(node, struct item, node)->value == 3);
+	TEST_ASSERT(iqueue_dequeue(&q) == NULL);
+	TEST_ASSERT(iqueue_length(&q) == 0);
+}
+
 int main(void)
 {
 	// Test individual methods
@@ -198,11 +291,15 @@ int main(void)
 	test_dequeue();
 	test_delete();
 	test_iterator();
+	test_iterator_enqueue();
 	test_length();
 
 	// scenario tests
 	test_queue_simple();
 
+	// intrusive variant
+	test_iqueue();
+
 	fprintf(stderr, "\n┬─┬ノ( º _ ºノ) Big Success\n");
 
 	return 0;
@@ -0,0 +1,182 @@
+/*
+ * Reader-writer lock tester
+ *
+ * Check the single-threaded semantics of reader-writer locks, then have
+ * writers update two values that must always be equal, yielding in between,
+ * while readers check that they never see them differ. Some locks are taken
+ * with the try variants. Runs with and without writer preference, with 1, 2
+ * and 4 workers, with and without preemption, and exits with status 1 as soon
+ * as a check fails.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <rwlock.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define READERS 8
+#define WRITERS 4
+#define READS 100000
+#define WRITES 20000
+
+static uthread_rwlock_t rwlock;
+static volatile unsigned long first, second;
+static unsigned long reads, torn;
+static int results[6];
+
+static void semantics(void *arg)
+{
+	(void)arg;
+
+	results[0] = uthread_rwlock_tryrdlock(&rwlock);
+	results[1] = uthread_rwlock_tryrdlock(&rwlock);
+	results[2] = uthread_rwlock_trywrlock(&rwlock);
+	uthread_rwlock_unlock(&rwlock);
+	uthread_rwlock_unlock(&rwlock);
+
+	results[3] = uthread_rwlock_trywrlock(&rwlock);
+	results[4] = uthread_rwlock_tryrdlock(&rwlock);
+	results[5] = uthread_rwlock_trywrlock(&rwlock);
+	uthread_rwlock_unlock(&rwlock);
+}
+
+void test_null(void)
+{
+	fprintf(stderr, "*** TEST null ***\n");
+
+	TEST_ASSERT(uthread_rwlock_init(NULL, false) == -1);
+	TEST_ASSERT(uthread_rwlock_rdlock(NULL) == -1);
+	TEST_ASSERT(uthread_rwlock_wrlock(NULL) == -1);
+	TEST_ASSERT(uthread_rwlock_tryrdlock(NULL) == -1);
+	TEST_ASSERT(uthread_rwlock_trywrlock(NULL) == -1);
+	TEST_ASSERT(uthread_rwlock_unlock(NULL) == -1);
+}
+
+void test_semantics(void)
+{
+	fprintf(stderr, "*** TEST semantics ***\n");
+
+	uthread_rwlock_init(&rwlock, false);
+	uthread_run(false, semantics, NULL);
+
+	// readers share the lock, and exclude a writer
+	TEST_ASSERT(results[0] == 0 && results[1] == 0);
+	TEST_ASSERT(results[2] == -1);
+
+	// a writer excludes everyone
+	TEST_ASSERT(results[3] == 0);
+	TEST_ASSERT(results[4] == -1 && results[5] == -1);
+}
+
+static void reader(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < READS; i++)
+	{
+		if (i % 5 == 0)
+		{
+			if (uthread_rwlock_tryrdlock(&rwlock) == -1)
+				continue;
+		}
+		else
+		{
+			uthread_rwlock_rdlock(&rwlock);
+		}
+
+		unsigned long value = first;
+		if (i % 3 == 0)
+			uthread_yield();
+		if (second != value)
+			__atomic_add_fetch(&torn, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&reads, 1, __ATOMIC_RELAXED);
+
+		uthread_rwlock_unlock(&rwlock);
+	}
+}
+
+static void writer(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < WRITES; i++)
+	{
+		if (i % 7 == 0)
+		{
+			while (uthread_rwlock_trywrlock(&rwlock) == -1)
+				uthread_yield();
+		}
+		else
+		{
+			uthread_rwlock_wrlock(&rwlock);
+		}
+
+		first++;
+		if (i % 2)
+			uthread_yield();
+		second++;
+
+		uthread_rwlock_unlock(&rwlock);
+	}
+}
+
+static void spawn(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < READERS; i++)
+		uthread_create(reader, NULL);
+	for (int i = 0; i < WRITERS; i++)
+		uthread_create(writer, NULL);
+}
+
+void test_stress(bool prefer_writers, unsigned int workers, bool preempt)
+{
+	fprintf(stderr, "*** TEST stress (%s, %u workers, %s) ***\n",
+			prefer_writers ? "writer preference" : "reader preference",
+			workers, preempt ? "preemptive" : "cooperative");
+
+	uthread_rwlock_init(&rwlock, prefer_writers);
+	first = second = 0;
+	reads = torn = 0;
+
+	TEST_ASSERT(uthread_run_mt(workers, preempt, spawn, NULL) == 0);
+	TEST_ASSERT(first == (unsigned long)WRITERS * WRITES);
+	TEST_ASSERT(second == first);
+	TEST_ASSERT(torn == 0);
+	TEST_ASSERT(reads > 0);
+}
+
+int main(void)
+{
+	test_null();
+	test_semantics();
+
+	for (int prefer_writers = 0; prefer_writers <= 1; prefer_writers++)
+	{
+		for (unsigned int workers = 1; workers <= 4; workers *= 2)
+		{
+			test_stress(prefer_writers, workers, false);
+			test_stress(prefer_writers, workers, true);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,414 @@
+/*
+ * Select tester
+ *
+ * Check the semantics of uthread_select() over semaphores and channels: the
+ * first ready case wins and is the only one done, a blocked select is woken up
+ * by whichever case completes first and removes its other registrations (so
+ * that their objects can be destroyed, but not before), stale registrations
+ * don't keep others from taking resources, and closing a channel completes
+ * its cases. Then selects that receive from one channel, send to another and take
+ * semaphores run against selects doing the opposite and against plain
+ * senders, receivers and sem_up(), with unbuffered and buffered channels, with
+ * 1, 2 and 4 workers, with and without preemption: every message sent must be
+ * received once, and every resource given taken once. Exits with status 1 as
+ * soon as a check fails.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <select.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define SELECTORS 4
+#define UPS 50000
+#define STRESS_NS 100000000ULL
+
+static sem_t sem, stop, tokens;
+static uthread_chan_t chan, other;
+static int results[8];
+
+#define ADD(counter, value) \
+	__atomic_add_fetch(&(counter), (value), __ATOMIC_RELAXED)
+
+void test_invalid(void)
+{
+	fprintf(stderr, "*** TEST invalid ***\n");
+
+	int value;
+	uthread_select_case_t cases[2] = {
+		{.op = UTHREAD_SELECT_DOWN, .sem = NULL},
+		{.op = UTHREAD_SELECT_RECV, .chan = NULL, .msg = &value},
+	};
+
+	TEST_ASSERT(uthread_select(NULL, 1) == -1);
+	TEST_ASSERT(uthread_select(cases, 0) == -1);
+	TEST_ASSERT(uthread_select(cases, 1) == -1);
+	TEST_ASSERT(uthread_select(&cases[1], 1) == -1);
+
+	cases[1].chan = uthread_chan_create(sizeof(int), 0);
+	cases[1].msg = NULL;
+	TEST_ASSERT(uthread_select(&cases[1], 1) == -1);
+	uthread_chan_destroy(cases[1].chan);
+}
+
+static void ready(void *arg)
+{
+	int in = 0, out = 7;
+	uthread_select_case_t cases[3] = {
+		{.op = UTHREAD_SELECT_SEND, .chan = other, .msg = &out},
+		{.op = UTHREAD_SELECT_RECV, .chan = chan, .msg = &in},
+		{.op = UTHREAD_SELECT_DOWN, .sem = sem},
+	};
+
+	(void)arg;
+
+	// nobody receives from @other, @chan has a message and @sem a resource
+	results[0] = uthread_select(cases, 3);
+	results[1] = in;
+	results[2] = cases[1].result;
+
+	// the resource is still there
+	results[3] = sem_trydown(sem);
+
+	// @chan is empty, so only @sem is ready now that it has a resource again
+	sem_up(sem);
+	results[4] = uthread_select(cases, 3);
+}
+
+void test_ready(void)
+{
+	fprintf(stderr, "*** TEST ready ***\n");
+
+	int value = 42;
+
+	sem = sem_create(1);
+	chan = uthread_chan_create(sizeof(int), 1);
+	other = uthread_chan_create(sizeof(int), 0);
+	uthread_chan_send(chan, &value);
+
+	uthread_run(false, ready, NULL);
+
+	TEST_ASSERT(results[0] == 1);
+	TEST_ASSERT(results[1] == 42 && results[2] == 0);
+	TEST_ASSERT(results[3] == 0);
+	TEST_ASSERT(results[4] == 2);
+
+	TEST_ASSERT(sem_destroy(sem) == 0);
+	TEST_ASSERT(uthread_chan_destroy(chan) == 0);
+	TEST_ASSERT(uthread_chan_destroy(other) == 0);
+}
+
+static void selector(void *arg)
+{
+	int in = 0, out = 1;
+	uthread_select_case_t cases[3] = {
+		{.op = UTHREAD_SELECT_RECV, .chan = chan, .msg = &in},
+		{.op = UTHREAD_SELECT_SEND, .chan = other, .msg = &out},
+		{.op = UTHREAD_SELECT_DOWN, .sem = sem},
+	};
+
+	(void)arg;
+
+	results[0] = uthread_select(cases, 3);
+	results[1] = cases[results[0]].result;
+
+	// the other registrations are gone
+	results[2] = uthread_chan_destroy(chan);
+	results[3] = uthread_chan_destroy(other);
+	results[4] = sem_destroy(sem);
+}
+
+static void cancel(void *arg)
+{
+	(void)arg;
+
+	uthread_create(selector, NULL);
+	uthread_yield();
+
+	// the select is registered with every object
+	results[5] = uthread_chan_destroy(chan);
+	results[6] = sem_destroy(sem);
+
+	sem_up(sem);
+}
+
+void test_cancel(void)
+{
+	fprintf(stderr, "*** TEST cancel ***\n");
+
+	sem = sem_create(0);
+	chan = uthread_chan_create(sizeof(int), 0);
+	other = uthread_chan_create(sizeof(int), 0);
+
+	uthread_run(false, cancel, NULL);
+
+	TEST_ASSERT(results[5] == -1 && results[6] == -1);
+	TEST_ASSERT(results[0] == 2 && results[1] == 0);
+	TEST_ASSERT(results[2] == 0 && results[3] == 0 && results[4] == 0);
+}
+
+static void closer(void *arg)
+{
+	(void)arg;
+
+	uthread_create(selector, NULL);
+	uthread_yield();
+
+	uthread_chan_close(other);
+}
+
+void test_close(void)
+{
+	fprintf(stderr, "*** TEST close ***\n");
+
+	sem = sem_create(0);
+	chan = uthread_chan_create(sizeof(int), 0);
+	other = uthread_chan_create(sizeof(int), 0);
+
+	uthread_run(false, closer, NULL);
+
+	TEST_ASSERT(results[0] == 1 && results[1] == UTHREAD_CHAN_CLOSED);
+	TEST_ASSERT(results[2] == 0 && results[3] == 0 && results[4] == 0);
+}
+
+static void stale(void *arg)
+{
+	int value = 3;
+
+	(void)arg;
+
+	uthread_create(selector, NULL);
+	uthread_yield();
+
+	// wins the select, which doesn't run before we yield
+	uthread_chan_send(chan, &value);
+
+	// its registration with @sem is stale but still there
+	sem_up(sem);
+	results[5] = sem_trydown(sem);
+	results[6] = sem_destroy(sem);
+}
+
+void test_stale(void)
+{
+	fprintf(stderr, "*** TEST stale ***\n");
+
+	sem = sem_create(0);
+	chan = uthread_chan_create(sizeof(int), 0);
+	other = uthread_chan_create(sizeof(int), 0);
+
+	uthread_run(false, stale, NULL);
+
+	TEST_ASSERT(results[5] == 0);
+	TEST_ASSERT(results[6] == -1);
+	TEST_ASSERT(results[0] == 0 && results[1] == 0);
+	TEST_ASSERT(results[2] == 0 && results[3] == 0 && results[4] == 0);
+}
+
+/* Messages are unique, so that sums tell whether one was lost or duplicated */
+static unsigned long sent_a, received_a, sum_sent_a, sum_received_a;
+static unsigned long sent_b, received_b, sum_sent_b, sum_received_b;
+static unsigned long ups, downs;
+
+// Receives from @chan, sends to @other, takes @tokens
+static void forward_selector(void *arg)
+{
+	unsigned long seq = (unsigned long)arg << 32;
+	unsigned long in, out;
+	uthread_select_case_t cases[4] = {
+		{.op = UTHREAD_SELECT_DOWN, .sem = stop},
+		{.op = UTHREAD_SELECT_RECV, .chan = chan, .msg = &in},
+		{.op = UTHREAD_SELECT_SEND, .chan = other, .msg = &out},
+		{.op = UTHREAD_SELECT_DOWN, .sem = tokens},
+	};
+
+	for (;;)
+	{
+		out = ++seq;
+
+		switch (uthread_select(cases, 4))
+		{
+		case 0:
+			return;
+		case 1:
+			ADD(received_a, 1);
+			ADD(sum_received_a, in);
+			break;
+		case 2:
+			ADD(sent_b, 1);
+			ADD(sum_sent_b, out);
+			break;
+		case 3:
+			ADD(downs, 1);
+			break;
+		}
+
+		if (seq % 5 == 0)
+			uthread_yield();
+	}
+}
+
+// Sends to @chan, receives from @other
+static void backward_selector(void *arg)
+{
+	unsigned long seq = (unsigned long)arg << 32;
+	unsigned long in, out;
+	uthread_select_case_t cases[3] = {
+		{.op = UTHREAD_SELECT_SEND, .chan = chan, .msg = &out},
+		{.op = UTHREAD_SELECT_RECV, .chan = other, .msg = &in},
+		{.op = UTHREAD_SELECT_DOWN, .sem = stop},
+	};
+
+	for (;;)
+	{
+		out = ++seq;
+
+		switch (uthread_select(cases, 3))
+		{
+		case 0:
+			ADD(sent_a, 1);
+			ADD(sum_sent_a, out);
+			break;
+		case 1:
+			ADD(received_b, 1);
+			ADD(sum_received_b, in);
+			break;
+		case 2:
+			return;
+		}
+	}
+}
+
+static void plain_sender(void *arg)
+{
+	unsigned long seq = (unsigned long)arg << 32;
+
+	for (;;)
+	{
+		unsigned long value = ++seq;
+
+		if (uthread_chan_send(chan, &value) != 0)
+			return;
+		ADD(sent_a, 1);
+		ADD(sum_sent_a, value);
+	}
+}
+
+static void plain_receiver(void *arg)
+{
+	unsigned long value;
+
+	(void)arg;
+
+	while (uthread_chan_recv(other, &value) == 0)
+	{
+		ADD(received_b, 1);
+		ADD(sum_received_b, value);
+	}
+}
+
+static void plain_up(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < UPS; i++)
+	{
+		sem_up(tokens);
+		ADD(ups, 1);
+		if (i % 3 == 0)
+			uthread_yield();
+	}
+}
+
+static void control(void *arg)
+{
+	unsigned long id = 1;
+
+	(void)arg;
+
+	for (int i = 0; i < SELECTORS; i++)
+	{
+		uthread_create(forward_selector, (void *)id++);
+		uthread_create(backward_selector, (void *)id++);
+	}
+	uthread_create(plain_sender, (void *)id++);
+	uthread_create(plain_receiver, NULL);
+	uthread_create(plain_up, NULL);
+
+	// stop the selectors, then the plain threads once they're gone
+	uthread_sleep_ns(STRESS_NS);
+	sem_up_n(stop, 2 * SELECTORS);
+	uthread_sleep_ns(STRESS_NS / 2);
+	uthread_chan_close(chan);
+	uthread_chan_close(other);
+}
+
+void test_stress(size_t capacity, unsigned int workers, bool preempt)
+{
+	unsigned long left = 0;
+
+	fprintf(stderr, "*** TEST stress (capacity %zu, %u workers, %s) ***\n",
+			capacity, workers, preempt ? "preemptive" : "cooperative");
+
+	chan = uthread_chan_create(sizeof(unsigned long), 0);
+	other = uthread_chan_create(sizeof(unsigned long), capacity);
+	stop = sem_create(0);
+	tokens = sem_create(0);
+	sent_a = received_a = sum_sent_a = sum_received_a = 0;
+	sent_b = received_b = sum_sent_b = sum_received_b = 0;
+	ups = downs = 0;
+
+	TEST_ASSERT(uthread_run_mt(workers, preempt, control, NULL) == 0);
+
+	while (sem_trydown(tokens) == 0)
+		left++;
+
+	TEST_ASSERT(sent_a == received_a && sum_sent_a == sum_received_a);
+	TEST_ASSERT(sent_b == received_b && sum_sent_b == sum_received_b);
+	TEST_ASSERT(received_a > 0 && received_b > 0);
+	TEST_ASSERT(downs + left == ups);
+
+	TEST_ASSERT(uthread_chan_destroy(chan) == 0);
+	TEST_ASSERT(uthread_chan_destroy(other) == 0);
+	TEST_ASSERT(sem_destroy(stop) == 0);
+	TEST_ASSERT(sem_destroy(tokens) == 0);
+}
+
+int main(void)
+{
+	static const size_t capacities[] = {0, 4};
+
+	test_invalid();
+	test_ready();
+	test_cancel();
+	test_close();
+	test_stale();
+
+	for (int i = 0; i < 2; i++)
+	{
+		for (unsigned int workers = 1; workers <= 4; workers *= 2)
+		{
+			test_stress(capacities[i], workers, false);
+			test_stress(capacities[i], workers, true);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * Semaphore timeout test
+ *
+ * A server has two slots to handle requests, each taking 20ms. Ten requests
+ * come in at once, and each gives up if it can't get a slot within 30ms: the
+ * first two are handled right away, the next two once the first ones are done,
+ * and the others are shed. Then check that sem_trydown() never blocks. Exits
+ * with status 1 as soon as a check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define SLOTS 2
+#define REQUESTS 10
+#define HANDLE_NS 20000000ULL
+#define TIMEOUT_NS 30000000ULL
+
+static sem_t slots;
+static unsigned int served, shed;
+static int results[3];
+
+static void request(void *arg)
+{
+	int ret = sem_down_timeout(slots, TIMEOUT_NS);
+	(void)arg;
+
+	if (ret == SEM_TIMEDOUT)
+	{
+		shed++;
+		return;
+	}
+
+	uthread_sleep_ns(HANDLE_NS);
+	served++;
+	sem_up(slots);
+}
+
+static void server(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < REQUESTS; i++)
+		uthread_create(request, NULL);
+}
+
+static void trydown(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < 3; i++)
+		results[i] = sem_trydown(slots);
+	sem_up(slots);
+	sem_up(slots);
+}
+
+void test_shed(void)
+{
+	fprintf(stderr, "*** TEST shed ***\n");
+
+	TEST_ASSERT(uthread_run(false, server, NULL) == 0);
+	TEST_ASSERT(served == 4);
+	TEST_ASSERT(shed == 6);
+}
+
+void test_trydown(void)
+{
+	fprintf(stderr, "*** TEST trydown ***\n");
+
+	// both slots are back, the third try doesn't wait for one
+	TEST_ASSERT(uthread_run(false, trydown, NULL) == 0);
+	TEST_ASSERT(results[0] == 0 && results[1] == 0);
+	TEST_ASSERT(results[2] == SEM_TIMEDOUT);
+	TEST_ASSERT(sem_trydown(NULL) == -1);
+}
+
+int main(void)
+{
+	slots = sem_create(SLOTS);
+
+	test_shed();
+	test_trydown();
+
+	TEST_ASSERT(sem_destroy(slots) == 0);
+
+	return 0;
+}
@@ -0,0 +1,328 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chan.h"
+#include "iqueue.h"
+#include "private.h"
+#include "spinlock.h"
+
+/*
+ * Buffered messages are in a ring buffer. Senders only wait when it is full,
+ * and receivers when it is empty. Whoever dequeues a waiter completes its
+ * operation for it (copying the message in or out) before unblocking it.
+ *
+ * Both queues can only have waiters at the same time because of selects. The
+ * registrations of a select that another case won stay queued, skipped by
+ * everyone, until the select removes them.
+ */
+struct channel
+{
+	spinlock_t lock;
+	bool closed;
+	size_t size;
+	size_t capacity;
+	size_t head;
+	size_t count;
+	struct iqueue senders;
+	struct iqueue receivers;
+	char buffer[];
+};
+
+typedef struct channel channel;
+
+// Message @i of the buffer, counting from the oldest one
+static void *chan_slot(channel *chan, size_t i)
+{
+	return chan->buffer + (chan->head + i) % chan->capacity * chan->size;
+}
+
+// Dequeue the oldest waiter whose operation can still be done
+static struct chan_waiter *chan_dequeue(struct iqueue *queue)
+{
+	struct iqueue_node *node;
+
+	for (node = queue->head.next; node != &queue->head; node = node->next)
+	{
+		struct chan_waiter *w =
+			iqueue_entry(node, struct chan_waiter, waiter.node);
+
+		if (w->select == NULL || select_claim(w->select, w->index))
+		{
+			iqueue_delete(queue, node);
+			return w;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * chan_try - Send or receive without waiting, with the lock held
+ *
+ * Return: true if the operation is done, with its result in @status
+ */
+static bool chan_try(channel *chan, bool send, void *msg, int *status,
+					 struct chan_waiter **peer)
+{
+	*peer = NULL;
+	*status = 0;
+
+	if (send)
+	{
+		if (chan->closed)
+		{
+			*status = UTHREAD_CHAN_CLOSED;
+			return true;
+		}
+
+		// straight into a waiting receiver
+		*peer = chan_dequeue(&chan->receivers);
+		if (*peer != NULL)
+		{
+			memcpy((*peer)->msg, msg, chan->size);
+			(*peer)->status = 0;
+			return true;
+		}
+
+		if (chan->count < chan->capacity)
+		{
+			memcpy(chan_slot(chan, chan->count), msg, chan->size);
+			chan->count++;
+			return true;
+		}
+
+		return false;
+	}
+
+	if (chan->count > 0)
+	{
+		memcpy(msg, chan_slot(chan, 0), chan->size);
+		chan->head = (chan->head + 1) % chan->capacity;
+		chan->count--;
+
+		// the oldest blocked sender takes the slot we just freed
+		*peer = chan_dequeue(&chan->senders);
+		if (*peer != NULL)
+		{
+			memcpy(chan_slot(chan, chan->count), (*peer)->msg, chan->size);
+			chan->count++;
+			(*peer)->status = 0;
+		}
+
+		return true;
+	}
+
+	*peer = chan_dequeue(&chan->senders);
+	if (*peer != NULL)
+	{
+		memcpy(msg, (*peer)->msg, chan->size);
+		(*peer)->status = 0;
+		return true;
+	}
+
+	if (chan->closed)
+	{
+		*status = UTHREAD_CHAN_CLOSED;
+		return true;
+	}
+
+	return false;
+}
+
+void chan_wake(struct chan_waiter *w, bool next)
+{
+	if (w->select != NULL)
+	{
+		select_wake(w->select, next);
+	}
+	else if (next)
+	{
+		uthread_unblock_next(w->waiter.thread);
+	}
+	else
+	{
+		uthread_unblock(w->waiter.thread);
+	}
+}
+
+uthread_chan_t uthread_chan_create(size_t size, size_t capacity)
+{
+	// the buffer size must not wrap around
+	if (size == 0 ||
+		(capacity != 0 && size > (SIZE_MAX - sizeof(channel)) / capacity))
+	{
+		return NULL;
+	}
+
+	channel *chan = malloc(sizeof(channel) + size * capacity);
+
+	if (chan == NULL)
+	{
+		return NULL;
+	}
+
+	spin_init(&chan->lock);
+	chan->closed = false;
+	chan->size = size;
+	chan->capacity = capacity;
+	chan->head = 0;
+	chan->count = 0;
+	iqueue_init(&chan->senders);
+	iqueue_init(&chan->receivers);
+
+	return chan;
+}
+
+int uthread_chan_destroy(uthread_chan_t chan)
+{
+	if (chan == NULL)
+	{
+		return -1;
+	}
+
+	preempt_disable();
+	spin_lock(&chan->lock);
+	bool busy = iqueue_length(&chan->senders) > 0 ||
+				iqueue_length(&chan->receivers) > 0;
+	spin_unlock(&chan->lock);
+	preempt_enable();
+
+	if (busy)
+	{
+		return -1;
+	}
+
+	free(chan);
+
+	return 0;
+}
+
+static int chan_op(channel *chan, bool send, void *msg)
+{
+	struct chan_waiter *peer;
+	int status;
+
+	preempt_disable();
+	spin_lock(&chan->lock);
+
+	if (chan_try(chan, send, msg, &status, &peer))
+	{
+		spin_unlock(&chan->lock);
+
+		// a receiver handed a message runs next
+		if (peer != NULL)
+		{
+			chan_wake(peer, send);
+		}
+
+		preempt_enable();
+		return status;
+	}
+
+	struct chan_waiter w;
+
+	w.waiter.thread = uthread_current();
+	w.msg = msg;
+	w.status = 0;
+	w.select = NULL;
+
+	// the operation is done for us, see chan_try()
+	iqueue_enqueue(send ? &chan->senders : &chan->receivers, &w.waiter.node);
+	uthread_block(&chan->lock);
+
+	preempt_enable();
+
+	return w.status;
+}
+
+int uthread_chan_send(uthread_chan_t chan, const void *msg)
+{
+	if (chan == NULL || msg == NULL)
+	{
+		return -1;
+	}
+
+	return chan_op(chan, true, (void *)msg);
+}
+
+int uthread_chan_recv(uthread_chan_t chan, void *msg)
+{
+	if (chan == NULL || msg == NULL)
+	{
+		return -1;
+	}
+
+	return chan_op(chan, false, msg);
+}
+
+int uthread_chan_close(uthread_chan_t chan)
+{
+	if (chan == NULL)
+	{
+		return -1;
+	}
+
+	preempt_disable();
+	spin_lock(&chan->lock);
+
+	if (chan->closed)
+	{
+		spin_unlock(&chan->lock);
+		preempt_enable();
+		return -1;
+	}
+
+	chan->closed = true;
+
+	// Every waiter fails, the receivers didn't find any message
+	struct iqueue failed;
+	struct iqueue_node *node;
+	struct chan_waiter *w;
+
+	iqueue_init(&failed);
+	while ((w = chan_dequeue(&chan->senders)) != NULL ||
+		   (w = chan_dequeue(&chan->receivers)) != NULL)
+	{
+		w->status = UTHREAD_CHAN_CLOSED;
+		iqueue_enqueue(&failed, &w->waiter.node);
+	}
+
+	spin_unlock(&chan->lock);
+
+	while ((node = iqueue_dequeue(&failed)) != NULL)
+	{
+		chan_wake(iqueue_entry(node, struct chan_waiter, waiter.node), false);
+	}
+
+	preempt_enable();
+
+	return 0;
+}
+
+spinlock_t *chan_select_lock(uthread_chan_t chan)
+{
+	return &chan->lock;
+}
+
+bool chan_select_try(uthread_chan_t chan, bool send, void *msg, int *status,
+					 struct chan_waiter **peer)
+{
+	return chan_try(chan, send, msg, status, peer);
+}
+
+void chan_select_wait(uthread_chan_t chan, bool send, struct chan_waiter *w)
+{
+	iqueue_enqueue(send ? &chan->senders : &chan->receivers, &w->waiter.node);
+}
+
+void chan_select_cancel(uthread_chan_t chan, bool send, struct chan_waiter *w)
+{
+	if (iqueue_linked(&w->waiter.node))
+	{
+		iqueue_delete(send ? &chan->senders : &chan->receivers,
+					  &w->waiter.node);
+	}
+}
@@ -0,0 +1,84 @@
+#ifndef _UTHREAD_CHAN_H
+#define _UTHREAD_CHAN_H
+
+#include <sys/types.h>
+
+/*
+ * uthread_chan_t - Channel type
+ *
+ * A channel carries messages of a fixed size from sending threads to receiving
+ * threads, in order. A buffered channel holds up to its capacity of messages
+ * that were sent but not received yet, and senders only wait when it is full.
+ * With an unbuffered channel (a capacity of 0), a sender always waits for a
+ * receiver to take its message.
+ *
+ * Messages are copied into a receiver that is already waiting, without going
+ * through the buffer, and the receiver runs next.
+ */
+typedef struct channel *uthread_chan_t;
+
+/* Returned when sending to or receiving from a closed channel */
+#define UTHREAD_CHAN_CLOSED (-2)
+
+/*
+ * uthread_chan_create - Create channel
+ * @size: Size of a message in bytes
+ * @capacity: Number of messages buffered, 0 for an unbuffered channel
+ *
+ * Return: Pointer to initialized channel. NULL if @size is 0, if the buffer
+ * of @capacity messages of @size bytes is too large, or in case of failure
+ * when allocating the channel.
+ */
+uthread_chan_t uthread_chan_create(size_t size, size_t capacity);
+
+/*
+ * uthread_chan_destroy - Deallocate a channel
+ * @chan: Channel to deallocate
+ *
+ * Messages still buffered in @chan are lost.
+ *
+ * Return: -1 if @chan is NULL or if threads are still blocked on @chan,
+ * including in a uthread_select() that hasn't returned yet. 0 if @chan was
+ * successfully destroyed.
+ */
+int uthread_chan_destroy(uthread_chan_t chan);
+
+/*
+ * uthread_chan_send - Send a message to a channel
+ * @chan: Channel to send to
+ * @msg: Message to send, of the size of @chan's messages
+ *
+ * If no receiver waits and the buffer of @chan is full (or @chan is
+ * unbuffered), the caller thread is blocked until a receiver takes the
+ * message or there is room in the buffer.
+ *
+ * Return: -1 if @chan or @msg is NULL. UTHREAD_CHAN_CLOSED if @chan is closed,
+ * in which case the message wasn't sent. 0 once the message is sent.
+ */
+int uthread_chan_send(uthread_chan_t chan, const void *msg);
+
+/*
+ * uthread_chan_recv - Receive a message from a channel
+ * @chan: Channel to receive from
+ * @msg: Where to copy the message, of the size of @chan's messages
+ *
+ * If no message is available, the caller thread is blocked until one is sent.
+ *
+ * Return: -1 if @chan or @msg is NULL. UTHREAD_CHAN_CLOSED if @chan is closed
+ * and every message sent before was received. 0 once a message is received.
+ */
+int uthread_chan_recv(uthread_chan_t chan, void *msg);
+
+/*
+ * uthread_chan_close - Close a channel
+ * @chan: Channel to close
+ *
+ * No message can be sent to @chan anymore. Blocked senders get
+ * UTHREAD_CHAN_CLOSED back. Receivers still get the buffered messages, then
+ * UTHREAD_CHAN_CLOSED.
+ *
+ * Return: -1 if @chan is NULL or already closed. 0 otherwise.
+ */
+int uthread_chan_close(uthread_chan_t chan);
+
+#endif /* _UTHREAD_CHAN_H */
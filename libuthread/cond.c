@@ -0,0 +1,110 @@
+#include <stddef.h>
+
+#include "cond.h"
+#include "iqueue.h"
+#include "mutex.h"
+#include "private.h"
+#include "spinlock.h"
+
+/*
+ * Waiting threads are linked by the ready queue node of their sched_entity,
+ * which a blocked thread doesn't use. A broadcast can then splice the whole
+ * waiter queue onto the ready queue, see uthread_unblock_all().
+ */
+
+int uthread_cond_init(uthread_cond_t *cond)
+{
+	if (cond == NULL)
+	{
+		return -1;
+	}
+
+	*cond = (uthread_cond_t)UTHREAD_COND_INITIALIZER;
+
+	return 0;
+}
+
+int uthread_cond_wait(uthread_cond_t *cond, uthread_mutex_t *mutex)
+{
+	if (cond == NULL || mutex == NULL)
+	{
+		return -1;
+	}
+
+	preempt_disable();
+	spin_lock(&cond->lock);
+
+	// statically initialized condition variables get their queue on first wait
+	if (cond->waiters.head.next == NULL)
+	{
+		iqueue_init(&cond->waiters);
+	}
+
+	iqueue_enqueue(&cond->waiters, &uthread_sched_entity(uthread_current())->node);
+
+	// signals can't get in before we're blocked, they need cond->lock
+	uthread_mutex_unlock(mutex);
+	uthread_block(&cond->lock);
+
+	preempt_enable();
+
+	return uthread_mutex_lock(mutex);
+}
+
+int uthread_cond_signal(uthread_cond_t *cond)
+{
+	if (cond == NULL)
+	{
+		return -1;
+	}
+
+	preempt_disable();
+	spin_lock(&cond->lock);
+
+	struct iqueue_node *node = NULL;
+
+	if (cond->waiters.head.next != NULL)
+	{
+		node = iqueue_dequeue(&cond->waiters);
+	}
+
+	spin_unlock(&cond->lock);
+
+	if (node != NULL)
+	{
+		uthread_unblock(
+			sched_entity_thread(iqueue_entry(node, struct sched_entity, node)));
+	}
+
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_cond_broadcast(uthread_cond_t *cond)
+{
+	if (cond == NULL)
+	{
+		return -1;
+	}
+
+	struct iqueue woken;
+
+	iqueue_init(&woken);
+
+	preempt_disable();
+	spin_lock(&cond->lock);
+
+	if (cond->waiters.head.next != NULL)
+	{
+		iqueue_splice(&woken, &cond->waiters);
+	}
+
+	spin_unlock(&cond->lock);
+
+	uthread_unblock_all(&woken);
+
+	preempt_enable();
+
+	return 0;
+}
@@ -0,0 +1,71 @@
+#ifndef _UTHREAD_COND_H
+#define _UTHREAD_COND_H
+
+#include "iqueue.h"
+#include "mutex.h"
+#include "spinlock.h"
+
+/*
+ * uthread_cond_t - Condition variable type
+ *
+ * A condition variable lets threads wait, with a mutex held, until another
+ * thread tells them that something they're waiting for may have happened.
+ * Waiters must check their condition again after waking up, in a loop, since
+ * it may have changed again in the meantime.
+ *
+ * The fields are private to the library.
+ */
+typedef struct uthread_cond
+{
+	spinlock_t lock;
+	struct iqueue waiters;
+} uthread_cond_t;
+
+/* Static initializer of a condition variable */
+#define UTHREAD_COND_INITIALIZER {0}
+
+/*
+ * uthread_cond_init - Initialize a condition variable
+ * @cond: Condition variable to initialize
+ *
+ * Same as assigning UTHREAD_COND_INITIALIZER. A condition variable doesn't need
+ * to be destroyed.
+ *
+ * Return: -1 if @cond is NULL. 0 otherwise.
+ */
+int uthread_cond_init(uthread_cond_t *cond);
+
+/*
+ * uthread_cond_wait - Wait on a condition variable
+ * @cond: Condition variable to wait on
+ * @mutex: Mutex held by the caller
+ *
+ * Unlock @mutex and block the caller thread until @cond is signaled, then lock
+ * @mutex again. No signal is missed between unlocking @mutex and blocking.
+ *
+ * Return: -1 if @cond or @mutex is NULL. 0 once woken up, with @mutex held.
+ */
+int uthread_cond_wait(uthread_cond_t *cond, uthread_mutex_t *mutex);
+
+/*
+ * uthread_cond_signal - Wake up one thread waiting on a condition variable
+ * @cond: Condition variable to signal
+ *
+ * The thread that has been waiting the longest is unblocked, if any.
+ *
+ * Return: -1 if @cond is NULL. 0 otherwise.
+ */
+int uthread_cond_signal(uthread_cond_t *cond);
+
+/*
+ * uthread_cond_broadcast - Wake up all threads waiting on a condition variable
+ * @cond: Condition variable to broadcast
+ *
+ * The waiting threads are all moved to the ready queue at once, which doesn't
+ * depend on their number with FIFO scheduling or several workers.
+ *
+ * Return: -1 if @cond is NULL. 0 otherwise.
+ */
+int uthread_cond_broadcast(uthread_cond_t *cond);
+
+#endif /* _UTHREAD_COND_H */
@@ -1,11 +1,115 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "private.h"
 #include "uthread.h"
 
-/* Size of the stack for a thread (in bytes) */
-#define UTHREAD_STACK_SIZE 32768
+/* Default number of idle stacks kept resident in the stack pool */
+#define UTHREAD_STACK_WATERMARK 64
+
+/* Maximum number of idle stacks kept in the pool, extra ones are unmapped */
+#define UTHREAD_STACK_POOL_MAX 1024
+
+/* Number of distinct stack sizes the pool keeps stacks for */
+#define UTHREAD_STACK_CLASSES 8
+
+/* Number of stacks put back in the pool between two trims */
+#define UTHREAD_STACK_TRIM_PERIOD 1024
+
+/*
+ * Stacks are mmap'd with a PROT_NONE guard page right below them, so that an
+ * overflow faults immediately instead of silently corrupting the heap. Stacks
+ * of exited threads are kept in a LIFO pool, one per stack size, and recycled
+ * by the next allocations of the same size.
+ *
+ * Every UTHREAD_STACK_TRIM_PERIOD stacks put back, the stacks at the bottom of
+ * a pool that stayed idle since the previous trim give their memory back to the
+ * kernel with MADV_FREE, as long as more stacks than the watermark are
+ * resident. They stay mapped and can still be recycled. The top of the pool,
+ * which create/exit churn keeps recycling, is never trimmed.
+ */
+struct stack_class
+{
+	size_t size;
+	unsigned int len;
+	unsigned int cap;
+	// stacks below @trimmed were trimmed, and those below @low stayed idle
+	// since the last trim
+	unsigned int trimmed;
+	unsigned int low;
+	void **stacks;
+};
+
+static struct stack_class stack_classes[UTHREAD_STACK_CLASSES];
+static unsigned int stack_pool_len;
+static unsigned int stack_resident;
+static unsigned int stack_frees;
+static unsigned int stack_watermark = UTHREAD_STACK_WATERMARK;
+static size_t page_size;
+
+#ifdef UTHREAD_CTX_ASM
+
+/*
+ * uthread_ctx_switch - Hand-written x86-64 context switch
+ *
+ * Only the registers the System V ABI requires a callee to preserve are saved:
+ * %rbp, %rbx, %r12-%r15, plus the SSE control/status word and the x87 control
+ * word. They are pushed on the current stack, whose pointer is stored in @prev,
+ * and popped back from the stack of @next. Unlike swapcontext(), the signal
+ * mask is left alone, which saves a rt_sigprocmask syscall on every switch.
+ */
+__asm__(
+	".text\n"
+	".globl uthread_ctx_switch\n"
+	".type uthread_ctx_switch, @function\n"
+	"uthread_ctx_switch:\n"
+	"	pushq %rbp\n"
+	"	pushq %rbx\n"
+	"	pushq %r12\n"
+	"	pushq %r13\n"
+	"	pushq %r14\n"
+	"	pushq %r15\n"
+	"	subq $8, %rsp\n"
+	"	stmxcsr (%rsp)\n"
+	"	fnstcw 4(%rsp)\n"
+	"	movq %rsp, (%rdi)\n"
+	"	movq (%rsi), %rsp\n"
+	"	ldmxcsr (%rsp)\n"
+	"	fldcw 4(%rsp)\n"
+	"	addq $8, %rsp\n"
+	"	popq %r15\n"
+	"	popq %r14\n"
+	"	popq %r13\n"
+	"	popq %r12\n"
+	"	popq %rbx\n"
+	"	popq %rbp\n"
+	"	ret\n"
+	".size uthread_ctx_switch, .-uthread_ctx_switch\n");
+
+/*
+ * uthread_ctx_trampoline - First return address of a new context
+ *
+ * The initial frame built by uthread_ctx_init() parks the bootstrap function in
+ * %r12 and its two arguments in %r13 and %r14.
+ */
+void uthread_ctx_trampoline(void);
+
+__asm__(
+	".text\n"
+	".type uthread_ctx_trampoline, @function\n"
+	"uthread_ctx_trampoline:\n"
+	"	movq %r13, %rdi\n"
+	"	movq %r14, %rsi\n"
+	"	callq *%r12\n"
+	"	ud2\n"
+	".size uthread_ctx_trampoline, .-uthread_ctx_trampoline\n");
+
+#else
 
 void uthread_ctx_switch(uthread_ctx_t *prev, uthread_ctx_t *next)
 {
@@ -20,14 +124,158 @@ void uthread_ctx_switch(uthread_ctx_t *prev, uthread_ctx_t *next)
 	}
 }
 
-void *uthread_ctx_alloc_stack(void)
+#endif /* UTHREAD_CTX_ASM */
+
+/*
+ * stack_round - Round a stack size up to a whole number of pages
+ */
+static size_t stack_round(size_t size)
+{
+	if (page_size == 0)
+	{
+		page_size = sysconf(_SC_PAGESIZE);
+	}
+
+	return (size + page_size - 1) & ~(page_size - 1);
+}
+
+/*
+ * stack_class_get - Find the pool of stacks of a given size
+ * @size: Stack size, rounded to pages
+ * @create: Claim an unused class if none matches yet
+ */
+static struct stack_class *stack_class_get(size_t size, bool create)
+{
+	for (int i = 0; i < UTHREAD_STACK_CLASSES; i++)
+	{
+		if (stack_classes[i].size == size)
+		{
+			return &stack_classes[i];
+		}
+
+		if (stack_classes[i].size == 0)
+		{
+			if (!create)
+			{
+				return NULL;
+			}
+			stack_classes[i].size = size;
+			return &stack_classes[i];
+		}
+	}
+
+	return NULL;
+}
+
+void *uthread_ctx_alloc_stack(size_t size)
+{
+	size = stack_round(size);
+
+	struct stack_class *class = stack_class_get(size, false);
+	if (class != NULL && class->len > 0)
+	{
+		stack_pool_len--;
+		class->len--;
+		if (class->len < class->trimmed)
+		{
+			class->trimmed = class->len;
+		}
+		else
+		{
+			stack_resident--;
+		}
+		if (class->len < class->low)
+		{
+			class->low = class->len;
+		}
+		return class->stacks[class->len];
+	}
+
+	char *region = mmap(NULL, page_size + size, PROT_READ | PROT_WRITE,
+						MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+	if (region == MAP_FAILED)
+	{
+		return NULL;
+	}
+
+	// stacks grow down, so the guard page goes at the lowest address
+	if (mprotect(region, page_size, PROT_NONE) == -1)
+	{
+		munmap(region, page_size + size);
+		return NULL;
+	}
+
+	return region + page_size;
+}
+
+/*
+ * stack_trim - Give the memory of stacks idle since the last trim back
+ */
+static void stack_trim(void)
 {
-	return malloc(UTHREAD_STACK_SIZE);
+	for (int i = 0; i < UTHREAD_STACK_CLASSES && stack_classes[i].size != 0;
+		 i++)
+	{
+		struct stack_class *class = &stack_classes[i];
+
+		// coldest first, the bottom of the pool
+		while (class->trimmed < class->low && stack_resident > stack_watermark)
+		{
+			madvise(class->stacks[class->trimmed], class->size, MADV_FREE);
+			class->trimmed++;
+			stack_resident--;
+		}
+
+		class->low = class->len;
+	}
 }
 
-void uthread_ctx_destroy_stack(void *top_of_stack)
+void uthread_ctx_destroy_stack(void *top_of_stack, size_t size)
 {
-	free(top_of_stack);
+	size = stack_round(size);
+
+	struct stack_class *class = NULL;
+	if (stack_pool_len < UTHREAD_STACK_POOL_MAX)
+	{
+		class = stack_class_get(size, true);
+	}
+
+	if (class != NULL && class->len == class->cap)
+	{
+		unsigned int cap = class->cap ? class->cap * 2 : 16;
+		void **stacks = realloc(class->stacks, cap * sizeof(void *));
+
+		if (stacks != NULL)
+		{
+			class->stacks = stacks;
+			class->cap = cap;
+		}
+		else
+		{
+			class = NULL;
+		}
+	}
+
+	if (class == NULL)
+	{
+		munmap((char *)top_of_stack - page_size, page_size + size);
+		return;
+	}
+
+	class->stacks[class->len++] = top_of_stack;
+	stack_pool_len++;
+	stack_resident++;
+
+	if (++stack_frees == UTHREAD_STACK_TRIM_PERIOD)
+	{
+		stack_frees = 0;
+		stack_trim();
+	}
+}
+
+void uthread_set_stack_watermark(unsigned int count)
+{
+	stack_watermark = count;
 }
 
 /*
@@ -38,8 +286,10 @@ void uthread_ctx_destroy_stack(void *top_of_stack)
 static void uthread_ctx_bootstrap(uthread_func_t func, void *arg)
 {
 	/*
-	 * Enable interrupts right after being elected to run for the first time
+	 * Clean up after the thread we replaced, and enable interrupts right after
+	 * being elected to run for the first time
 	 */
+	uthread_finish_switch();
 	preempt_enable();
 
 	/* Execute thread and when done, exit */
@@ -47,8 +297,45 @@ static void uthread_ctx_bootstrap(uthread_func_t func, void *arg)
 	uthread_exit();
 }
 
+#ifdef UTHREAD_CTX_ASM
+
 int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
-					 uthread_func_t func, void *arg)
+					 size_t stack_size, uthread_func_t func, void *arg)
+{
+	uint32_t mxcsr;
+	uint16_t fpucw;
+	uint64_t *frame;
+
+	/*
+	 * Build the frame uthread_ctx_switch() expects to pop, right below the
+	 * (16-byte aligned) end of the stack segment. Once popped, the final
+	 * `ret` lands in uthread_ctx_trampoline() with an aligned stack.
+	 */
+	frame = (uint64_t *)(((uintptr_t)top_of_stack + stack_size) & ~15UL);
+	frame -= 8;
+
+	/* New threads inherit the floating point environment of their creator */
+	__asm__ volatile("stmxcsr %0" : "=m"(mxcsr));
+	__asm__ volatile("fnstcw %0" : "=m"(fpucw));
+
+	frame[0] = mxcsr | (uint64_t)fpucw << 32;
+	frame[1] = 0;							/* %r15 */
+	frame[2] = (uint64_t)arg;				/* %r14 */
+	frame[3] = (uint64_t)func;				/* %r13 */
+	frame[4] = (uint64_t)uthread_ctx_bootstrap; /* %r12 */
+	frame[5] = 0;							/* %rbx */
+	frame[6] = 0;							/* %rbp */
+	frame[7] = (uint64_t)uthread_ctx_trampoline;
+
+	uctx->sp = frame;
+
+	return 0;
+}
+
+#else
+
+int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
+					 size_t stack_size, uthread_func_t func, void *arg)
 {
 	/*
 	 * Initialize the passed context @uctx to the currently active context
@@ -60,7 +347,7 @@ int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
 	 * Change context @uctx's stack to the specified stack
 	 */
 	uctx->uc_stack.ss_sp = top_of_stack;
-	uctx->uc_stack.ss_size = UTHREAD_STACK_SIZE;
+	uctx->uc_stack.ss_size = stack_size;
 
 	/*
 	 * Finish setting up context @uctx:
@@ -74,3 +361,5 @@ int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
 
 	return 0;
 }
+
+#endif /* UTHREAD_CTX_ASM */
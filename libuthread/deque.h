@@ -0,0 +1,105 @@
+#ifndef _DEQUE_H
+#define _DEQUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Number of items a deque holds, must be a power of two */
+#define DEQUE_SIZE 1024
+
+/*
+ * deque - Work-stealing queue
+ *
+ * Bounded single-producer, multi-consumer FIFO of pointers, laid out like a
+ * Chase-Lev deque without the owner's pop at the bottom. Only the owner pushes
+ * items at the bottom, and anyone (the owner included) takes items from the
+ * top, so that items come out in FIFO order. Taking an item is lock-free:
+ * takers only race on the top index with a compare-and-swap.
+ */
+struct deque
+{
+	long top;
+	char pad[64 - sizeof(long)];
+	long bottom;
+	void *items[DEQUE_SIZE];
+};
+
+/*
+ * deque_init - Initialize an empty deque
+ * @deque: Deque to initialize
+ */
+static inline void deque_init(struct deque *deque)
+{
+	deque->top = 0;
+	deque->bottom = 0;
+}
+
+/*
+ * deque_push - Push item at the bottom
+ * @deque: Deque owned by the caller
+ * @item: Item to push
+ *
+ * Return: true if @item was pushed, false if @deque is full.
+ */
+static inline bool deque_push(struct deque *deque, void *item)
+{
+	long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+	long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+
+	if (bottom - top >= DEQUE_SIZE)
+	{
+		return false;
+	}
+
+	__atomic_store_n(&deque->items[bottom & (DEQUE_SIZE - 1)], item,
+					 __ATOMIC_RELAXED);
+	__atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+/*
+ * deque_take - Take item from the top
+ * @deque: Deque to take from
+ *
+ * Return: Oldest item of @deque, or NULL if @deque is empty.
+ */
+static inline void *deque_take(struct deque *deque)
+{
+	for (;;)
+	{
+		long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+
+		if (top >= bottom)
+		{
+			return NULL;
+		}
+
+		void *item = __atomic_load_n(&deque->items[top & (DEQUE_SIZE - 1)],
+									 __ATOMIC_RELAXED);
+
+		// the slot can't be reused by a push before top moves past it
+		if (__atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+										__ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+		{
+			return item;
+		}
+	}
+}
+
+/*
+ * deque_empty - Check whether a deque looks empty
+ * @deque: Deque to check
+ *
+ * The result can be stale by the time it is used, if other workers push to or
+ * take from @deque.
+ */
+static inline bool deque_empty(struct deque *deque)
+{
+	return __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE) >=
+		   __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+}
+
+#endif /* _DEQUE_H */
@@ -0,0 +1,662 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "io.h"
+#include "iqueue.h"
+#include "private.h"
+#include "spinlock.h"
+
+/* File descriptors are tracked in pages of this many entries */
+#define IO_FD_PAGE_SIZE 1024
+
+/* Number of pages, which bounds the file descriptors that can be waited on */
+#define IO_FD_PAGES 1024
+
+/* Maximum number of events handled by a single epoll_wait() */
+#define IO_EVENTS 64
+
+/* Number of schedules between two polls while threads are ready to run */
+#define IO_POLL_INTERVAL 64
+
+/* epoll data of the eventfd interrupting io_poll() */
+#define IO_INTERRUPT UINT64_MAX
+
+/* epoll data of the eventfd of the helper pool */
+#define IO_POOL (UINT64_MAX - 1)
+
+/* epoll data of the io_uring */
+#define IO_URING (UINT64_MAX - 2)
+
+/* epoll data of the timerfd */
+#define IO_TIMER (UINT64_MAX - 3)
+
+/*
+ * State of a file descriptor
+ *
+ * Threads waiting for a file descriptor are queued on it, and the file
+ * descriptor is armed in the epoll set in one-shot mode for the directions
+ * someone is waiting for. The poller re-arms it if needed.
+ */
+struct io_fd
+{
+	spinlock_t lock;
+	bool nonblock;
+	bool was_blocking;
+	bool registered;
+	struct iqueue readers;
+	struct iqueue writers;
+};
+
+/* Thread waiting for a file descriptor, failed with @error once it's closed */
+struct io_fd_waiter
+{
+	struct uthread_waiter waiter;
+	int error;
+};
+
+// Pages are allocated on demand, and never move so that their locks stay put
+static struct io_fd *io_fds[IO_FD_PAGES];
+static spinlock_t io_fds_lock = SPINLOCK_INIT;
+
+static int epoll_fd = -1;
+static int interrupt_fd = -1;
+
+// Number of threads blocked on I/O (sockets, files, helpers) or sleeping
+static unsigned int io_waiters;
+
+// Whether a worker is sleeping in io_poll(), see io_interrupt()
+static bool io_sleeping;
+
+static struct io_fd *io_fd_get(int fd)
+{
+	if (fd < 0 || fd >= IO_FD_PAGE_SIZE * IO_FD_PAGES)
+	{
+		errno = EBADF;
+		return NULL;
+	}
+
+	struct io_fd **page = &io_fds[fd / IO_FD_PAGE_SIZE];
+	struct io_fd *fds = __atomic_load_n(page, __ATOMIC_ACQUIRE);
+
+	if (fds == NULL)
+	{
+		preempt_disable();
+		spin_lock(&io_fds_lock);
+		fds = *page;
+		if (fds == NULL)
+		{
+			fds = calloc(IO_FD_PAGE_SIZE, sizeof(struct io_fd));
+			if (fds != NULL)
+			{
+				for (int i = 0; i < IO_FD_PAGE_SIZE; i++)
+				{
+					iqueue_init(&fds[i].readers);
+					iqueue_init(&fds[i].writers);
+				}
+				__atomic_store_n(page, fds, __ATOMIC_RELEASE);
+			}
+		}
+		spin_unlock(&io_fds_lock);
+		preempt_enable();
+
+		if (fds == NULL)
+		{
+			errno = ENOMEM;
+			return NULL;
+		}
+	}
+
+	return &fds[fd % IO_FD_PAGE_SIZE];
+}
+
+// Switch @fd to non-blocking mode the first time it is used
+static struct io_fd *io_fd_prepare(int fd)
+{
+	struct io_fd *f = io_fd_get(fd);
+
+	if (f == NULL || __atomic_load_n(&f->nonblock, __ATOMIC_RELAXED))
+	{
+		return f;
+	}
+
+	int flags = fcntl(fd, F_GETFL);
+
+	if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+	{
+		return NULL;
+	}
+
+	if (!(flags & O_NONBLOCK))
+	{
+		__atomic_store_n(&f->was_blocking, true, __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&f->nonblock, true, __ATOMIC_RELAXED);
+	return f;
+}
+
+// Switch @fd back to blocking mode if io_fd_prepare() changed it, since the
+// open file description may be shared with other processes (e.g., stdin)
+static void io_fd_restore(int fd, struct io_fd *f)
+{
+	if (!f->was_blocking)
+	{
+		return;
+	}
+
+	int flags = fcntl(fd, F_GETFL);
+
+	if (flags != -1)
+	{
+		fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+	}
+
+	f->was_blocking = false;
+}
+
+// Arm @fd for the directions threads wait for, with @f locked
+static int io_arm(int fd, struct io_fd *f)
+{
+	struct epoll_event event;
+
+	event.events = EPOLLONESHOT;
+	if (iqueue_length(&f->readers) > 0)
+	{
+		event.events |= EPOLLIN | EPOLLRDHUP;
+	}
+	if (iqueue_length(&f->writers) > 0)
+	{
+		event.events |= EPOLLOUT;
+	}
+	event.data.u64 = fd;
+
+	// epoll forgets file descriptors once they're closed
+	int op = f->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+
+	if (epoll_ctl(epoll_fd, op, fd, &event) == -1)
+	{
+		op = op == EPOLL_CTL_MOD ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+		if ((errno != ENOENT && errno != EEXIST) ||
+			epoll_ctl(epoll_fd, op, fd, &event) == -1)
+		{
+			return -1;
+		}
+	}
+
+	f->registered = true;
+	return 0;
+}
+
+/*
+ * io_wait - Block until a file descriptor is ready
+ * @fd: File descriptor to wait for
+ * @events: EPOLLIN or EPOLLOUT
+ *
+ * Return: 0 once @fd may be ready (the operation must be retried), or -1 in
+ * case of failure or if @fd was closed meanwhile (errno is set)
+ */
+static int io_wait(int fd, uint32_t events)
+{
+	struct io_fd *f = io_fd_get(fd);
+
+	if (f == NULL)
+	{
+		return -1;
+	}
+
+	struct iqueue *queue = events == EPOLLIN ? &f->readers : &f->writers;
+	struct io_fd_waiter w;
+
+	preempt_disable();
+	spin_lock(&f->lock);
+
+	w.waiter.thread = uthread_current();
+	w.error = 0;
+	iqueue_enqueue(queue, &w.waiter.node);
+
+	if (io_arm(fd, f) == -1)
+	{
+		iqueue_delete(queue, &w.waiter.node);
+		spin_unlock(&f->lock);
+		preempt_enable();
+		return -1;
+	}
+
+	io_waiter_add();
+
+	// the lock is released once we're switched out
+	uthread_block(&f->lock);
+
+	preempt_enable();
+
+	if (w.error != 0)
+	{
+		errno = w.error;
+		return -1;
+	}
+
+	return 0;
+}
+
+// Move every waiter of @from to @to
+static void io_take_waiters(struct iqueue *from, struct iqueue *to)
+{
+	struct iqueue_node *node;
+
+	while ((node = iqueue_dequeue(from)) != NULL)
+	{
+		iqueue_enqueue(to, node);
+	}
+}
+
+static void io_handle(int fd, uint32_t events)
+{
+	struct io_fd *f = io_fd_get(fd);
+	struct iqueue woken;
+
+	iqueue_init(&woken);
+
+	spin_lock(&f->lock);
+
+	if (events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+	{
+		io_take_waiters(&f->readers, &woken);
+	}
+	if (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+	{
+		io_take_waiters(&f->writers, &woken);
+	}
+
+	// one-shot: still waiting in the other direction
+	if (iqueue_length(&f->readers) > 0 || iqueue_length(&f->writers) > 0)
+	{
+		io_arm(fd, f);
+	}
+
+	spin_unlock(&f->lock);
+
+	// waiters live on the stack of their thread, which may run as soon as it
+	// is unblocked
+	struct iqueue_node *node;
+
+	while ((node = iqueue_dequeue(&woken)) != NULL)
+	{
+		io_waiter_done(
+			iqueue_entry(node, struct io_fd_waiter, waiter.node)->waiter.thread);
+	}
+}
+
+// Fail every thread waiting on a file descriptor being closed, with @f locked
+static void io_fail_waiters(struct io_fd *f, struct iqueue *woken)
+{
+	struct iqueue_node *node;
+
+	io_take_waiters(&f->readers, woken);
+	io_take_waiters(&f->writers, woken);
+
+	for (node = woken->head.next; node != &woken->head; node = node->next)
+	{
+		iqueue_entry(node, struct io_fd_waiter, waiter.node)->error = EBADF;
+	}
+}
+
+// Add a file descriptor that the poller watches for the library itself
+static int io_watch(int fd, uint64_t data)
+{
+	struct epoll_event event;
+
+	event.events = EPOLLIN;
+	event.data.u64 = data;
+	return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+int io_start(const uthread_run_attr_t *attr)
+{
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd == -1)
+	{
+		return -1;
+	}
+
+	interrupt_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (interrupt_fd == -1)
+	{
+		close(epoll_fd);
+		epoll_fd = -1;
+		return -1;
+	}
+
+	if (io_watch(interrupt_fd, IO_INTERRUPT) == -1)
+	{
+		io_stop();
+		return -1;
+	}
+
+	int fd = pool_start(attr->helpers);
+
+	if (fd == -1 || io_watch(fd, IO_POOL) == -1)
+	{
+		io_stop();
+		return -1;
+	}
+
+	fd = timer_start();
+	if (fd == -1 || io_watch(fd, IO_TIMER) == -1)
+	{
+		io_stop();
+		return -1;
+	}
+
+	// file I/O falls back to the helper pool without an io_uring
+	fd = uring_start(attr->io_uring);
+	if (fd != -1 && io_watch(fd, IO_URING) == -1)
+	{
+		uring_stop();
+	}
+
+	io_waiters = 0;
+	io_sleeping = false;
+
+	return 0;
+}
+
+void io_stop(void)
+{
+	uring_stop();
+	pool_stop();
+	timer_stop();
+
+	if (interrupt_fd != -1)
+	{
+		close(interrupt_fd);
+		interrupt_fd = -1;
+	}
+
+	if (epoll_fd != -1)
+	{
+		close(epoll_fd);
+		epoll_fd = -1;
+	}
+
+	for (int i = 0; i < IO_FD_PAGES; i++)
+	{
+		for (int j = 0; io_fds[i] != NULL && j < IO_FD_PAGE_SIZE; j++)
+		{
+			io_fd_restore(i * IO_FD_PAGE_SIZE + j, &io_fds[i][j]);
+		}
+
+		free(io_fds[i]);
+		io_fds[i] = NULL;
+	}
+}
+
+bool io_pending(void)
+{
+	return __atomic_load_n(&io_waiters, __ATOMIC_SEQ_CST) > 0;
+}
+
+void io_waiter_add(void)
+{
+	__atomic_add_fetch(&io_waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+void io_waiter_done(struct uthread_tcb *thread)
+{
+	// counted out only once unblocked, see park_worker()
+	uthread_unblock(thread);
+	__atomic_sub_fetch(&io_waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+void io_flush(void)
+{
+	uring_flush();
+}
+
+void io_poll(bool block)
+{
+	struct epoll_event events[IO_EVENTS];
+
+	io_flush();
+
+	if (block)
+	{
+		__atomic_store_n(&io_sleeping, true, __ATOMIC_SEQ_CST);
+	}
+
+	// a preemption tick interrupts the wait, which is fine
+	int count = epoll_wait(epoll_fd, events, IO_EVENTS, block ? -1 : 0);
+
+	if (block)
+	{
+		__atomic_store_n(&io_sleeping, false, __ATOMIC_SEQ_CST);
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		if (events[i].data.u64 == IO_INTERRUPT)
+		{
+			uint64_t value;
+
+			if (read(interrupt_fd, &value, sizeof(value)) == -1)
+			{
+				// already drained by another worker
+			}
+			continue;
+		}
+
+		if (events[i].data.u64 == IO_POOL)
+		{
+			pool_reap();
+			continue;
+		}
+
+		if (events[i].data.u64 == IO_URING)
+		{
+			uring_reap();
+			continue;
+		}
+
+		if (events[i].data.u64 == IO_TIMER)
+		{
+			timer_clear();
+			continue;
+		}
+
+		io_handle(events[i].data.u64, events[i].events);
+	}
+
+	// busy workers don't wait for the timerfd
+	timer_expire();
+}
+
+bool io_poll_due(unsigned int *schedules)
+{
+	if (!io_pending() || ++*schedules < IO_POLL_INTERVAL)
+	{
+		return false;
+	}
+
+	*schedules = 0;
+	return true;
+}
+
+void io_interrupt(void)
+{
+	if (__atomic_load_n(&io_sleeping, __ATOMIC_SEQ_CST))
+	{
+		uint64_t value = 1;
+
+		if (write(interrupt_fd, &value, sizeof(value)) == -1)
+		{
+			// the counter is saturated, io_poll() wakes up anyway
+		}
+	}
+}
+
+ssize_t uthread_read(int fd, void *buf, size_t count)
+{
+	if (io_fd_prepare(fd) == NULL)
+	{
+		return -1;
+	}
+
+	for (;;)
+	{
+		ssize_t ret = read(fd, buf, count);
+
+		if (ret >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+		{
+			return ret;
+		}
+
+		if (io_wait(fd, EPOLLIN) == -1)
+		{
+			return -1;
+		}
+	}
+}
+
+ssize_t uthread_write(int fd, const void *buf, size_t count)
+{
+	if (io_fd_prepare(fd) == NULL)
+	{
+		return -1;
+	}
+
+	for (;;)
+	{
+		ssize_t ret = write(fd, buf, count);
+
+		if (ret >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+		{
+			return ret;
+		}
+
+		if (io_wait(fd, EPOLLOUT) == -1)
+		{
+			return -1;
+		}
+	}
+}
+
+int uthread_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen)
+{
+	if (io_fd_prepare(sockfd) == NULL)
+	{
+		return -1;
+	}
+
+	for (;;)
+	{
+		int fd = accept4(sockfd, addr, addrlen, SOCK_NONBLOCK);
+
+		if (fd >= 0)
+		{
+			struct io_fd *f = io_fd_get(fd);
+
+			if (f != NULL)
+			{
+				__atomic_store_n(&f->nonblock, true, __ATOMIC_RELAXED);
+			}
+			return fd;
+		}
+
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+		{
+			return -1;
+		}
+
+		if (io_wait(sockfd, EPOLLIN) == -1)
+		{
+			return -1;
+		}
+	}
+}
+
+int uthread_connect(int sockfd, const struct sockaddr *addr,
+					socklen_t addrlen)
+{
+	if (io_fd_prepare(sockfd) == NULL)
+	{
+		return -1;
+	}
+
+	if (connect(sockfd, addr, addrlen) == 0)
+	{
+		return 0;
+	}
+
+	if (errno != EINPROGRESS)
+	{
+		return -1;
+	}
+
+	// the socket becomes writable once the connection is established or failed
+	if (io_wait(sockfd, EPOLLOUT) == -1)
+	{
+		return -1;
+	}
+
+	int error;
+	socklen_t len = sizeof(error);
+
+	if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &error, &len) == -1)
+	{
+		return -1;
+	}
+
+	if (error != 0)
+	{
+		errno = error;
+		return -1;
+	}
+
+	return 0;
+}
+
+int uthread_close(int fd)
+{
+	struct io_fd *f = io_fd_get(fd);
+	struct iqueue woken;
+	struct iqueue_node *node;
+	int ret;
+
+	if (f == NULL)
+	{
+		return close(fd);
+	}
+
+	iqueue_init(&woken);
+
+	preempt_disable();
+	spin_lock(&f->lock);
+
+	io_fd_restore(fd, f);
+	f->nonblock = false;
+	f->registered = false;
+	io_fail_waiters(f, &woken);
+
+	// closed under the lock, so that nobody arms the number once reused
+	// before we're done with it
+	ret = close(fd);
+
+	spin_unlock(&f->lock);
+
+	// epoll forgets @fd, the waiters would never hear of it again
+	while ((node = iqueue_dequeue(&woken)) != NULL)
+	{
+		io_waiter_done(
+			iqueue_entry(node, struct io_fd_waiter, waiter.node)->waiter.thread);
+	}
+
+	preempt_enable();
+
+	return ret;
+}
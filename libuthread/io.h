@@ -0,0 +1,133 @@
+#ifndef _UTHREAD_IO_H
+#define _UTHREAD_IO_H
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include "uthread.h"
+
+/*
+ * Non-blocking I/O
+ *
+ * These functions behave like the system calls they are named after, except
+ * that they only block the calling thread: the file descriptor is switched to
+ * non-blocking mode, and whenever the call would block, the thread waits for
+ * the file descriptor to become ready while other threads keep running. Once
+ * no thread is ready to run, the library sleeps until some I/O completes.
+ *
+ * They can only be called from threads of the library. File descriptors used
+ * with them should be closed with uthread_close(). Those that were in blocking
+ * mode are switched back to it by uthread_close(), or once uthread_run()
+ * returns for those still open, since other processes may share them (e.g.,
+ * stdin).
+ */
+
+/*
+ * uthread_read - Read from a file descriptor
+ * @fd: File descriptor to read from
+ * @buf: Buffer to read into
+ * @count: Maximum number of bytes to read
+ *
+ * Return: Number of bytes read, 0 at end of file, or -1 in case of failure
+ * (errno is set).
+ */
+ssize_t uthread_read(int fd, void *buf, size_t count);
+
+/*
+ * uthread_write - Write to a file descriptor
+ * @fd: File descriptor to write to
+ * @buf: Buffer to write from
+ * @count: Maximum number of bytes to write
+ *
+ * Return: Number of bytes written, or -1 in case of failure (errno is set).
+ */
+ssize_t uthread_write(int fd, const void *buf, size_t count);
+
+/*
+ * uthread_accept - Accept a connection on a socket
+ * @sockfd: Listening socket
+ * @addr: Address of the peer, or NULL
+ * @addrlen: Size of @addr, updated with the actual size of the address
+ *
+ * The new socket is already in non-blocking mode.
+ *
+ * Return: File descriptor of the new socket, or -1 in case of failure (errno
+ * is set).
+ */
+int uthread_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
+
+/*
+ * uthread_connect - Connect a socket
+ * @sockfd: Socket to connect
+ * @addr: Address to connect to
+ * @addrlen: Size of @addr
+ *
+ * Return: 0 once connected, or -1 in case of failure (errno is set).
+ */
+int uthread_connect(int sockfd, const struct sockaddr *addr,
+					socklen_t addrlen);
+
+/*
+ * uthread_pread - Read from a file at a given offset
+ * @fd: File descriptor to read from
+ * @buf: Buffer to read into
+ * @count: Maximum number of bytes to read
+ * @offset: Offset in the file to read from
+ *
+ * Unlike the other functions, file I/O goes through io_uring (or helper kernel
+ * threads, see uthread_run_attr_t), so @fd is left in blocking mode and can be
+ * a regular file.
+ *
+ * Return: Number of bytes read, 0 at end of file, or -1 in case of failure
+ * (errno is set).
+ */
+ssize_t uthread_pread(int fd, void *buf, size_t count, off_t offset);
+
+/*
+ * uthread_pwrite - Write to a file at a given offset
+ * @fd: File descriptor to write to
+ * @buf: Buffer to write from
+ * @count: Maximum number of bytes to write
+ * @offset: Offset in the file to write at
+ *
+ * Return: Number of bytes written, or -1 in case of failure (errno is set).
+ */
+ssize_t uthread_pwrite(int fd, const void *buf, size_t count, off_t offset);
+
+/*
+ * uthread_fsync - Flush a file to its storage device
+ * @fd: File descriptor of the file
+ *
+ * Return: 0 in case of success, or -1 in case of failure (errno is set).
+ */
+int uthread_fsync(int fd);
+
+/*
+ * uthread_close - Close a file descriptor
+ * @fd: File descriptor to close
+ *
+ * Forget what the library knows about @fd before closing it, so that a file
+ * descriptor later opened with the same number starts afresh. Threads waiting
+ * on @fd fail with EBADF.
+ *
+ * Return: 0 in case of success, or -1 in case of failure (errno is set).
+ */
+int uthread_close(int fd);
+
+/*
+ * uthread_offload - Run a blocking function on a helper kernel thread
+ * @func: Function to run
+ * @arg: Argument to be passed to @func
+ *
+ * For calls that can't be made non-blocking (e.g., getaddrinfo(), opening a
+ * file on a slow filesystem, blocking libraries): @func runs on one of the
+ * helper kernel threads (see uthread_run_attr_t) while the calling thread is
+ * blocked, and the other threads keep running. @func must not call functions
+ * of the library, and runs with every signal blocked.
+ *
+ * Return: 0 once @func returned, or -1 if no helper could be started (@func
+ * didn't run)
+ */
+int uthread_offload(uthread_func_t func, void *arg);
+
+#endif /* _UTHREAD_IO_H */
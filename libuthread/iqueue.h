@@ -0,0 +1,174 @@
+#ifndef _IQUEUE_H
+#define _IQUEUE_H
+
+#include <stddef.h>
+
+/*
+ * iqueue - Intrusive queue type
+ *
+ * An intrusive queue is a FIFO data structure, like queue_t, except that the
+ * links between items live inside the items themselves: any structure that
+ * embeds a 'struct iqueue_node' can be enqueued, and enqueueing never allocates
+ * memory. The enclosing structure of a node is retrieved with iqueue_entry().
+ *
+ * An item can only be in one queue at a time per node it embeds. All
+ * operations are O(1), including deleting an item from the middle of a queue.
+ *
+ * Queues and nodes are meant to be embedded in other structures, so the
+ * functions below don't check for NULL pointers.
+ */
+struct iqueue_node
+{
+	struct iqueue_node *next;
+	struct iqueue_node *prev;
+};
+
+struct iqueue
+{
+	/* Sentinel: head.next is the oldest item, head.prev the newest */
+	struct iqueue_node head;
+	unsigned int length;
+};
+
+/*
+ * iqueue_entry - Get the structure containing a node
+ * @node: Pointer to the node
+ * @type: Type of the enclosing structure
+ * @member: Name of the node within the enclosing structure
+ */
+#define iqueue_entry(node, type, member) \
+	((type *)((char *)(node) - offsetof(type, member)))
+
+/*
+ * iqueue_init - Initialize an empty queue
+ * @queue: Queue to initialize
+ */
+static inline void iqueue_init(struct iqueue *queue)
+{
+	queue->head.next = &queue->head;
+	queue->head.prev = &queue->head;
+	queue->length = 0;
+}
+
+/*
+ * iqueue_node_init - Initialize a node that isn't in any queue
+ * @node: Node to initialize
+ */
+static inline void iqueue_node_init(struct iqueue_node *node)
+{
+	node->next = NULL;
+	node->prev = NULL;
+}
+
+/*
+ * iqueue_linked - Check whether a node is currently in a queue
+ * @node: Node to check, initialized with iqueue_node_init()
+ *
+ * Return: Non-zero if @node is in a queue, 0 otherwise.
+ */
+static inline int iqueue_linked(const struct iqueue_node *node)
+{
+	return node->next != NULL;
+}
+
+/*
+ * iqueue_length - Queue length
+ * @queue: Queue to get the length of
+ */
+static inline unsigned int iqueue_length(const struct iqueue *queue)
+{
+	return queue->length;
+}
+
+/*
+ * iqueue_enqueue - Enqueue item
+ * @queue: Queue in which to enqueue item
+ * @node: Node of the item to enqueue, which must not be in any queue
+ */
+static inline void iqueue_enqueue(struct iqueue *queue,
+								  struct iqueue_node *node)
+{
+	node->next = &queue->head;
+	node->prev = queue->head.prev;
+	queue->head.prev->next = node;
+	queue->head.prev = node;
+	queue->length++;
+}
+
+/*
+ * iqueue_push - Enqueue item at the front
+ * @queue: Queue in which to enqueue item
+ * @node: Node of the item to enqueue, which must not be in any queue
+ *
+ * The item is the next one iqueue_dequeue() returns.
+ */
+static inline void iqueue_push(struct iqueue *queue, struct iqueue_node *node)
+{
+	node->next = queue->head.next;
+	node->prev = &queue->head;
+	queue->head.next->prev = node;
+	queue->head.next = node;
+	queue->length++;
+}
+
+/*
+ * iqueue_delete - Delete item
+ * @queue: Queue in which @node currently is
+ * @node: Node of the item to delete
+ *
+ * Once deleted, iqueue_linked() returns 0 for @node.
+ */
+static inline void iqueue_delete(struct iqueue *queue,
+								 struct iqueue_node *node)
+{
+	node->prev->next = node->next;
+	node->next->prev = node->prev;
+	node->next = NULL;
+	node->prev = NULL;
+	queue->length--;
+}
+
+/*
+ * iqueue_dequeue - Dequeue item
+ * @queue: Queue in which to dequeue item
+ *
+ * Return: Node of the oldest item of @queue, which is removed from the queue,
+ * or NULL if @queue is empty.
+ */
+static inline struct iqueue_node *iqueue_dequeue(struct iqueue *queue)
+{
+	struct iqueue_node *node = queue->head.next;
+
+	if (node == &queue->head)
+	{
+		return NULL;
+	}
+
+	iqueue_delete(queue, node);
+	return node;
+}
+
+/*
+ * iqueue_splice - Move every item of a queue to the back of another
+ * @queue: Queue in which to enqueue the items
+ * @from: Queue to take the items from, which is left empty
+ *
+ * The items keep their order. This is O(1) whatever the number of items.
+ */
+static inline void iqueue_splice(struct iqueue *queue, struct iqueue *from)
+{
+	if (from->length == 0)
+	{
+		return;
+	}
+
+	from->head.next->prev = queue->head.prev;
+	queue->head.prev->next = from->head.next;
+	from->head.prev->next = &queue->head;
+	queue->head.prev = from->head.prev;
+	queue->length += from->length;
+
+	iqueue_init(from);
+}
+
+#endif /* _IQUEUE_H */
@@ -0,0 +1,179 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "iqueue.h"
+#include "mutex.h"
+#include "private.h"
+#include "spinlock.h"
+
+/*
+ * Mutex states
+ *
+ * The fast paths only move between MUTEX_UNLOCKED and MUTEX_LOCKED with a
+ * compare-and-swap. Once a thread may be waiting, the mutex is
+ * MUTEX_CONTENDED and both sides go through the spinlock and the waiters
+ * queue. A contended mutex is handed over to the oldest waiter directly, so
+ * that a thread that keeps locking and unlocking can't starve the others.
+ */
+enum
+{
+	MUTEX_UNLOCKED,
+	MUTEX_LOCKED,
+	MUTEX_CONTENDED,
+};
+
+#ifdef UTHREAD_DEBUG
+static void mutex_misuse(const char *what)
+{
+	fprintf(stderr, "uthread_mutex: %s\n", what);
+	abort();
+}
+#endif
+
+int uthread_mutex_init(uthread_mutex_t *mutex)
+{
+	if (mutex == NULL)
+	{
+		return -1;
+	}
+
+	*mutex = (uthread_mutex_t)UTHREAD_MUTEX_INITIALIZER;
+
+	return 0;
+}
+
+int uthread_mutex_trylock(uthread_mutex_t *mutex)
+{
+	int unlocked = MUTEX_UNLOCKED;
+
+	if (mutex == NULL ||
+		!__atomic_compare_exchange_n(&mutex->state, &unlocked, MUTEX_LOCKED,
+									 false, __ATOMIC_ACQUIRE,
+									 __ATOMIC_RELAXED))
+	{
+		return -1;
+	}
+
+	mutex->owner = uthread_current();
+
+	return 0;
+}
+
+int uthread_mutex_lock(uthread_mutex_t *mutex)
+{
+	if (mutex == NULL)
+	{
+		return -1;
+	}
+
+	if (uthread_mutex_trylock(mutex) == 0)
+	{
+		return 0;
+	}
+
+#ifdef UTHREAD_DEBUG
+	if (__atomic_load_n(&mutex->owner, __ATOMIC_RELAXED) == uthread_current())
+	{
+		mutex_misuse("locking a mutex already held by the caller");
+	}
+#endif
+
+	preempt_disable();
+	spin_lock(&mutex->lock);
+
+	// statically initialized mutexes get their queue on first contention
+	if (mutex->waiters.head.next == NULL)
+	{
+		iqueue_init(&mutex->waiters);
+	}
+
+	// the holder may have unlocked it in the meantime
+	if (__atomic_exchange_n(&mutex->state, MUTEX_CONTENDED,
+							__ATOMIC_ACQUIRE) == MUTEX_UNLOCKED)
+	{
+		if (iqueue_length(&mutex->waiters) == 0)
+		{
+			__atomic_store_n(&mutex->state, MUTEX_LOCKED, __ATOMIC_RELAXED);
+		}
+
+		mutex->owner = uthread_current();
+		spin_unlock(&mutex->lock);
+		preempt_enable();
+		return 0;
+	}
+
+	struct uthread_waiter waiter;
+
+	// the mutex is handed over to us, see uthread_mutex_unlock()
+	waiter.thread = uthread_current();
+	iqueue_enqueue(&mutex->waiters, &waiter.node);
+	uthread_block(&mutex->lock);
+
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_mutex_unlock(uthread_mutex_t *mutex)
+{
+	if (mutex == NULL)
+	{
+		return -1;
+	}
+
+#ifdef UTHREAD_DEBUG
+	if (__atomic_load_n(&mutex->state, __ATOMIC_RELAXED) == MUTEX_UNLOCKED)
+	{
+		mutex_misuse("unlocking a mutex that isn't locked");
+	}
+	if (mutex->owner != uthread_current())
+	{
+		mutex_misuse("unlocking a mutex held by another thread");
+	}
+#endif
+
+	mutex->owner = NULL;
+
+	int locked = MUTEX_LOCKED;
+
+	if (__atomic_compare_exchange_n(&mutex->state, &locked, MUTEX_UNLOCKED,
+									false, __ATOMIC_RELEASE,
+									__ATOMIC_RELAXED))
+	{
+		return 0;
+	}
+
+	preempt_disable();
+	spin_lock(&mutex->lock);
+
+	struct iqueue_node *node = iqueue_dequeue(&mutex->waiters);
+	struct uthread_tcb *thread = NULL;
+
+	if (node != NULL)
+	{
+		thread = iqueue_entry(node, struct uthread_waiter, node)->thread;
+		mutex->owner = thread;
+
+		// nobody left behind it, the next unlock can take the fast path
+		if (iqueue_length(&mutex->waiters) == 0)
+		{
+			__atomic_store_n(&mutex->state, MUTEX_LOCKED, __ATOMIC_RELAXED);
+		}
+	}
+	else
+	{
+		__atomic_store_n(&mutex->state, MUTEX_UNLOCKED, __ATOMIC_RELEASE);
+	}
+
+	spin_unlock(&mutex->lock);
+
+	if (thread != NULL)
+	{
+		uthread_unblock(thread);
+	}
+
+	preempt_enable();
+
+	return 0;
+}
@@ -0,0 +1,74 @@
+#ifndef _UTHREAD_MUTEX_H
+#define _UTHREAD_MUTEX_H
+
+#include "iqueue.h"
+#include "spinlock.h"
+#include "uthread.h"
+
+/*
+ * uthread_mutex_t - Mutex type
+ *
+ * A mutex protects a critical section: only the thread that locked it may be
+ * in the section, until it unlocks it. Unlike a semaphore, a mutex doesn't
+ * need to be allocated, and locking or unlocking a mutex nobody waits for is a
+ * single atomic operation. Threads waiting for a mutex get it in order.
+ *
+ * When the library is built with `make DEBUG=1`, misuses (locking a mutex
+ * twice, unlocking a mutex held by another thread or not held at all) abort
+ * the program with a message.
+ *
+ * The fields are private to the library.
+ */
+typedef struct uthread_mutex
+{
+	int state;
+	spinlock_t lock;
+	struct uthread_tcb *owner;
+	struct iqueue waiters;
+} uthread_mutex_t;
+
+/* Static initializer of an unlocked mutex */
+#define UTHREAD_MUTEX_INITIALIZER {0}
+
+/*
+ * uthread_mutex_init - Initialize an unlocked mutex
+ * @mutex: Mutex to initialize
+ *
+ * Same as assigning UTHREAD_MUTEX_INITIALIZER. A mutex doesn't need to be
+ * destroyed.
+ *
+ * Return: -1 if @mutex is NULL. 0 otherwise.
+ */
+int uthread_mutex_init(uthread_mutex_t *mutex);
+
+/*
+ * uthread_mutex_lock - Lock a mutex
+ * @mutex: Mutex to lock
+ *
+ * If @mutex is held by another thread, the caller thread is blocked until it
+ * is its turn to get it.
+ *
+ * Return: -1 if @mutex is NULL. 0 once @mutex is held by the caller.
+ */
+int uthread_mutex_lock(uthread_mutex_t *mutex);
+
+/*
+ * uthread_mutex_trylock - Lock a mutex without waiting
+ * @mutex: Mutex to lock
+ *
+ * Return: -1 if @mutex is NULL or held by a thread. 0 if @mutex is now held by
+ * the caller.
+ */
+int uthread_mutex_trylock(uthread_mutex_t *mutex);
+
+/*
+ * uthread_mutex_unlock - Unlock a mutex
+ * @mutex: Mutex held by the caller
+ *
+ * If threads are waiting for @mutex, the oldest one gets it and is unblocked.
+ *
+ * Return: -1 if @mutex is NULL. 0 otherwise.
+ */
+int uthread_mutex_unlock(uthread_mutex_t *mutex);
+
+#endif /* _UTHREAD_MUTEX_H */
@@ -0,0 +1,130 @@
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "iqueue.h"
+#include "park.h"
+#include "private.h"
+#include "spinlock.h"
+
+/* Number of wait buckets, as a power of 2 */
+#define PARK_BUCKETS_SHIFT 8
+#define PARK_BUCKETS (1 << PARK_BUCKETS_SHIFT)
+
+/* Cache line size, buckets are aligned on it so their locks don't share one */
+#define CACHE_LINE_SIZE 64
+
+/*
+ * Parked threads are in the wait bucket their address hashes to. Addresses
+ * sharing a bucket share its lock and queue, so unparking skips the threads
+ * waiting on other addresses; with enough buckets, a queue rarely holds more
+ * than one address.
+ */
+struct park_bucket
+{
+	spinlock_t lock;
+	struct iqueue waiters;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+struct park_waiter
+{
+	struct uthread_waiter waiter;
+	const unsigned int *addr;
+};
+
+static struct park_bucket buckets[PARK_BUCKETS];
+
+// Get the bucket of an address, locked
+static struct park_bucket *lock_bucket(const unsigned int *addr)
+{
+	// Fibonacci hashing, the low bits of the address are always 0
+	uint64_t hash = ((uintptr_t)addr >> 2) * 0x9e3779b97f4a7c15ULL;
+	struct park_bucket *bucket = &buckets[hash >> (64 - PARK_BUCKETS_SHIFT)];
+
+	spin_lock(&bucket->lock);
+
+	// the table is zeroed, queues are set up on first use
+	if (bucket->waiters.head.next == NULL)
+	{
+		iqueue_init(&bucket->waiters);
+	}
+
+	return bucket;
+}
+
+int uthread_park(const unsigned int *addr, unsigned int expected)
+{
+	if (addr == NULL)
+	{
+		return -1;
+	}
+
+	preempt_disable();
+	struct park_bucket *bucket = lock_bucket(addr);
+
+	// pairs with the lock taken by uthread_unpark() after changing the value
+	if (__atomic_load_n(addr, __ATOMIC_SEQ_CST) != expected)
+	{
+		spin_unlock(&bucket->lock);
+		preempt_enable();
+		return -1;
+	}
+
+	struct park_waiter w;
+
+	w.waiter.thread = uthread_current();
+	w.addr = addr;
+	iqueue_enqueue(&bucket->waiters, &w.waiter.node);
+	uthread_block(&bucket->lock);
+
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_unpark(const unsigned int *addr, unsigned int n)
+{
+	struct iqueue woken;
+	struct iqueue_node *node;
+	int count = 0;
+
+	if (addr == NULL)
+	{
+		return -1;
+	}
+
+	iqueue_init(&woken);
+
+	preempt_disable();
+	struct park_bucket *bucket = lock_bucket(addr);
+
+	node = bucket->waiters.head.next;
+	while (node != &bucket->waiters.head && (unsigned int)count < n &&
+		   count < INT_MAX)
+	{
+		struct iqueue_node *next = node->next;
+		struct park_waiter *w =
+			iqueue_entry(node, struct park_waiter, waiter.node);
+
+		if (w->addr == addr)
+		{
+			iqueue_delete(&bucket->waiters, node);
+			iqueue_enqueue(&woken, node);
+			count++;
+		}
+
+		node = next;
+	}
+
+	spin_unlock(&bucket->lock);
+
+	while ((node = iqueue_dequeue(&woken)) != NULL)
+	{
+		uthread_unblock(
+			iqueue_entry(node, struct park_waiter, waiter.node)->waiter.thread);
+	}
+
+	preempt_enable();
+
+	return count;
+}
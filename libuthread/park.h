@@ -0,0 +1,48 @@
+#ifndef _UTHREAD_PARK_H
+#define _UTHREAD_PARK_H
+
+/*
+ * Parking threads on an address
+ *
+ * uthread_park() and uthread_unpark() are the building blocks of custom
+ * synchronization objects, like futexes are for kernel threads. An object can
+ * be a single word: threads that need to wait park on its address while it
+ * holds a given value, and threads that change the value unpark them. Waiting
+ * threads are kept in a table shared by all addresses, so objects never need
+ * to allocate anything.
+ *
+ * For instance, a lock can be a word that is 0 when unlocked, 1 when locked,
+ * and 2 when locked with waiters. Locking it sets it to 2 and parks while it
+ * is 2, until it was 0; unlocking it sets it to 0 and unparks one thread if it
+ * was 2.
+ */
+
+/*
+ * uthread_park - Wait on an address
+ * @addr: Address to wait on
+ * @expected: Value that @addr must hold to wait
+ *
+ * If @addr still holds @expected, block the caller thread until another thread
+ * calls uthread_unpark() on @addr. Checking the value and waiting are atomic
+ * with respect to uthread_unpark(): a thread that changes the value at @addr
+ * and then unparks can't miss the caller.
+ *
+ * Callers must check their condition again once woken up, as the value may
+ * have changed again.
+ *
+ * Return: -1 if @addr is NULL or didn't hold @expected. 0 once woken up.
+ */
+int uthread_park(const unsigned int *addr, unsigned int expected);
+
+/*
+ * uthread_unpark - Wake up threads waiting on an address
+ * @addr: Address the threads wait on
+ * @n: Maximum number of threads to wake up
+ *
+ * The threads that have been waiting the longest are woken up first.
+ *
+ * Return: -1 if @addr is NULL. Otherwise, the number of threads woken up.
+ */
+int uthread_unpark(const unsigned int *addr, unsigned int n);
+
+#endif /* _UTHREAD_PARK_H */
@@ -0,0 +1,212 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "io.h"
+#include "iqueue.h"
+#include "private.h"
+#include "spinlock.h"
+
+// Jobs waiting for a helper, helpers sleep on the condition variable
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+static struct iqueue pool_jobs;
+static bool pool_stopping;
+
+// Helpers are only started by the first job
+static pthread_t *pool_threads;
+static unsigned int pool_size;
+static unsigned int pool_started;
+
+// Jobs done, until the poller wakes their thread up
+static spinlock_t done_lock = SPINLOCK_INIT;
+static struct iqueue done_jobs;
+
+// Written by helpers whenever a job is done, watched by the poller
+static int done_fd = -1;
+
+static void *pool_main(void *arg)
+{
+	(void)arg;
+
+	pthread_mutex_lock(&pool_mutex);
+
+	for (;;)
+	{
+		struct iqueue_node *node;
+
+		while ((node = iqueue_dequeue(&pool_jobs)) == NULL && !pool_stopping)
+		{
+			pthread_cond_wait(&pool_cond, &pool_mutex);
+		}
+
+		if (node == NULL)
+		{
+			break;
+		}
+
+		pthread_mutex_unlock(&pool_mutex);
+
+		struct pool_job *job = iqueue_entry(node, struct pool_job, node);
+
+		job->func(job->arg);
+
+		// the thread that submitted the job may not be switched out yet
+		spin_lock(&job->lock);
+		spin_unlock(&job->lock);
+
+		// the job is gone as soon as the poller sees it
+		spin_lock(&done_lock);
+		iqueue_enqueue(&done_jobs, &job->node);
+		spin_unlock(&done_lock);
+
+		uint64_t value = 1;
+
+		if (write(done_fd, &value, sizeof(value)) == -1)
+		{
+			// the counter is saturated, the poller wakes up anyway
+		}
+
+		pthread_mutex_lock(&pool_mutex);
+	}
+
+	pthread_mutex_unlock(&pool_mutex);
+
+	return NULL;
+}
+
+// Start the helpers, with pool_mutex held
+static void pool_spawn(void)
+{
+	sigset_t all, old;
+
+	pool_threads = malloc(pool_size * sizeof(pthread_t));
+	if (pool_threads == NULL)
+	{
+		return;
+	}
+
+	// helpers must never get the preemption signals
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+
+	while (pool_started < pool_size &&
+		   pthread_create(&pool_threads[pool_started], NULL, pool_main,
+						  NULL) == 0)
+	{
+		pool_started++;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+int pool_start(unsigned int helpers)
+{
+	pool_size = helpers;
+	iqueue_init(&pool_jobs);
+	iqueue_init(&done_jobs);
+	pool_stopping = false;
+	pool_started = 0;
+
+	done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	return done_fd;
+}
+
+void pool_stop(void)
+{
+	pthread_mutex_lock(&pool_mutex);
+	pool_stopping = true;
+	pthread_cond_broadcast(&pool_cond);
+	pthread_mutex_unlock(&pool_mutex);
+
+	for (unsigned int i = 0; i < pool_started; i++)
+	{
+		pthread_join(pool_threads[i], NULL);
+	}
+	pool_started = 0;
+
+	free(pool_threads);
+	pool_threads = NULL;
+
+	if (done_fd != -1)
+	{
+		close(done_fd);
+		done_fd = -1;
+	}
+}
+
+int pool_run(struct pool_job *job)
+{
+	// a thread preempted with the mutex held would stall its worker
+	preempt_disable();
+	pthread_mutex_lock(&pool_mutex);
+
+	if (pool_threads == NULL)
+	{
+		pool_spawn();
+	}
+
+	if (pool_started == 0)
+	{
+		pthread_mutex_unlock(&pool_mutex);
+		preempt_enable();
+		return -1;
+	}
+
+	job->thread = uthread_current();
+	spin_init(&job->lock);
+	spin_lock(&job->lock);
+
+	iqueue_enqueue(&pool_jobs, &job->node);
+	pthread_cond_signal(&pool_cond);
+	pthread_mutex_unlock(&pool_mutex);
+
+	io_waiter_add();
+
+	// released once we're switched out, see pool_main()
+	uthread_block(&job->lock);
+
+	preempt_enable();
+
+	return 0;
+}
+
+void pool_reap(void)
+{
+	struct iqueue done;
+	struct iqueue_node *node;
+	uint64_t value;
+
+	if (read(done_fd, &value, sizeof(value)) == -1)
+	{
+		// already reaped by another worker
+	}
+
+	iqueue_init(&done);
+
+	spin_lock(&done_lock);
+	while ((node = iqueue_dequeue(&done_jobs)) != NULL)
+	{
+		iqueue_enqueue(&done, node);
+	}
+	spin_unlock(&done_lock);
+
+	while ((node = iqueue_dequeue(&done)) != NULL)
+	{
+		io_waiter_done(iqueue_entry(node, struct pool_job, node)->thread);
+	}
+}
+
+int uthread_offload(uthread_func_t func, void *arg)
+{
+	struct pool_job job;
+
+	job.func = func;
+	job.arg = arg;
+	return pool_run(&job);
+}
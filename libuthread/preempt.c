@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <signal.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -5,75 +6,238 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "private.h"
 #include "uthread.h"
 
+static struct sigaction handler_action;
+static struct sigaction old_action;
+
+// glibc doesn't name the target thread of SIGEV_THREAD_ID timers
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+// Timer configuration, from the attributes given to uthread_run_attr()
+static bool preempt_enabled;
+static uthread_clock_t preempt_clock;
+static unsigned int quantum_us;
+
+// With several workers, each one has its own timer measuring its own CPU time
+// (or elapsed time), so ITIMER_VIRTUAL can't be used
+static bool worker_timers;
+
+// Everything below is per worker, and only accessed from functions that don't
+// switch contexts before they are done with it
+
+// Timer of the worker, and whether it is valid
+static __thread timer_t preempt_timer;
+static __thread bool has_timer;
+
+// Whether the timer is currently armed, it is stopped while there is nothing
+// else to run since preempting would be pointless
+static __thread bool ticking;
+
+// Nesting depth of preempt_disable() calls, threads only get preempted at 0
+// Context switches always happen at depth 1, so the counter doesn't need to
+// be saved per thread
+static __thread volatile sig_atomic_t preempt_depth;
+
+// Set when a tick arrived while preemption was disabled
+static __thread volatile sig_atomic_t preempt_pending;
+
 /*
- * Frequency of preemption
- * 100Hz is 100 times per second
+ * set_timer - Arm or disarm the preemption timer
+ * @arm: Fire every quantum if true, stop the timer otherwise
  */
-#define HZ 100
+static void set_timer(bool arm)
+{
+	time_t sec = arm ? quantum_us / 1000000 : 0;
+	long usec = arm ? quantum_us % 1000000 : 0;
 
-struct itimerval *timer_val;
-struct sigaction *handler_action;
-sigset_t *block_alarm;
+	if (preempt_clock == UTHREAD_CLOCK_VIRTUAL && !worker_timers)
+	{
+		struct itimerval timer_val;
+
+		timer_val.it_interval.tv_sec = sec;
+		timer_val.it_interval.tv_usec = usec;
+		timer_val.it_value = timer_val.it_interval;
+		setitimer(ITIMER_VIRTUAL, &timer_val, NULL);
+	}
+	else if (has_timer)
+	{
+		struct itimerspec timer_spec;
+
+		timer_spec.it_interval.tv_sec = sec;
+		timer_spec.it_interval.tv_nsec = usec * 1000;
+		timer_spec.it_value = timer_spec.it_interval;
+		timer_settime(preempt_timer, 0, &timer_spec, NULL);
+	}
+
+	ticking = arm;
+}
 
 void preempt_handler()
 {
-	uthread_yield();
+	if (preempt_depth > 0)
+	{
+		// defer the yield to the matching preempt_enable()
+		preempt_pending = 1;
+		return;
+	}
+
+	// Nothing else to run, stop ticking until another thread becomes ready
+	if (!uthread_has_ready())
+	{
+		set_timer(false);
+		return;
+	}
+
+	uthread_preempt();
 }
 
 // Note: Enabling/disabling preemption only applies to the current thread context
+// Neither needs a syscall; a tick in between only sets preempt_pending
 
 void preempt_disable(void)
 {
-	sigprocmask(SIG_BLOCK, block_alarm, NULL);
+	preempt_depth++;
 }
 
 void preempt_enable(void)
 {
-	sigprocmask(SIG_UNBLOCK, block_alarm, NULL);
+	preempt_depth--;
+
+	if (preempt_depth == 0 && preempt_pending)
+	{
+		preempt_pending = 0;
+		uthread_preempt();
+	}
 }
 
-void preempt_start(bool preempt)
+void preempt_ready(void)
 {
-	// signal block mask for later
-	block_alarm = malloc(sizeof(sigset_t));
-	sigemptyset(block_alarm);
-	sigaddset(block_alarm, SIGVTALRM);
+	if (preempt_enabled && !ticking)
+	{
+		set_timer(true);
+	}
+}
 
-	// setup handler
-	handler_action = malloc(sizeof(struct sigaction));
-	handler_action->sa_handler = preempt_handler;
-	sigemptyset(&handler_action->sa_mask);
-	handler_action->sa_flags = 0;
+void preempt_park(void)
+{
+	if (preempt_enabled && ticking)
+	{
+		set_timer(false);
+	}
+}
 
-	sigaction(SIGVTALRM, handler_action, NULL);
+unsigned int preempt_quantum_us(void)
+{
+	return quantum_us;
+}
 
-	// setup timer
-	timer_val = malloc(sizeof(struct itimerval));
-	timer_val->it_interval.tv_usec = 1E6 / HZ;
-	timer_val->it_value.tv_usec = 1E6 / HZ;
+int preempt_start_worker(void)
+{
+	ticking = false;
+	has_timer = false;
+
+	if (!preempt_enabled ||
+		(preempt_clock == UTHREAD_CLOCK_VIRTUAL && !worker_timers))
+	{
+		return 0;
+	}
+
+	// ticks are sent to the worker itself, and never to other threads of the
+	// process
+	struct sigevent event;
+
+	event.sigev_notify = SIGEV_THREAD_ID;
+	event.sigev_signo = SIGVTALRM;
+	event.sigev_value.sival_ptr = NULL;
+	event.sigev_notify_thread_id = gettid();
+
+	clockid_t clock = preempt_clock == UTHREAD_CLOCK_MONOTONIC
+						  ? CLOCK_MONOTONIC
+						  : CLOCK_THREAD_CPUTIME_ID;
+	if (timer_create(clock, &event, &preempt_timer) == -1)
+	{
+		return -1;
+	}
+	has_timer = true;
+
+	set_timer(true);
+
+	return 0;
+}
+
+void preempt_stop_worker(void)
+{
+	if (preempt_enabled)
+	{
+		set_timer(false);
+	}
+
+	if (has_timer)
+	{
+		timer_delete(preempt_timer);
+		has_timer = false;
+	}
+
+	preempt_depth = 0;
+	preempt_pending = 0;
+}
+
+int preempt_start(const uthread_run_attr_t *attr)
+{
+	preempt_enabled = attr->preempt;
+	preempt_clock = attr->clock;
+	quantum_us = attr->quantum_us;
+	worker_timers = attr->workers > 1;
+	ticking = false;
+	has_timer = false;
+
+	if (!preempt_enabled)
+	{
+		return 0;
+	}
+
+	if (quantum_us == 0)
+	{
+		preempt_enabled = false;
+		return -1;
+	}
+
+	// setup handler
+	// The signal isn't blocked while the handler runs since the handler yields
+	// to other threads, preempt_depth protects against nested ticks instead
+	handler_action.sa_handler = preempt_handler;
+	sigemptyset(&handler_action.sa_mask);
+	handler_action.sa_flags = SA_NODEFER;
+
+	sigaction(SIGVTALRM, &handler_action, &old_action);
 
-	if (preempt)
+	if (preempt_start_worker() == -1)
 	{
-		setitimer(ITIMER_VIRTUAL, timer_val, NULL);
+		sigaction(SIGVTALRM, &old_action, NULL);
+		preempt_enabled = false;
+		return -1;
 	}
+
+	return 0;
 }
 
 void preempt_stop(void)
 {
 	// set timer back to default
-	timer_val->it_interval.tv_usec = 0;
-	timer_val->it_value.tv_usec = 0;
-	setitimer(ITIMER_VIRTUAL, timer_val, NULL);
-
-	// set handler back to default
-	handler_action->sa_handler = SIG_DFL;
-	sigaction(SIGVTALRM, handler_action, NULL);
+	// the idle thread disabled preemption before running the threads
+	preempt_stop_worker();
 
-	free(timer_val);
-	free(handler_action);
-	free(block_alarm);
+	if (preempt_enabled)
+	{
+		// set handler back to what it was
+		sigaction(SIGVTALRM, &old_action, NULL);
+		preempt_enabled = false;
+	}
 }
@@ -10,10 +10,24 @@
 /**
  * Private context API
  */
-#include <ucontext.h>
+#include <stddef.h>
+#include <stdint.h>
 
+#include "iqueue.h"
+#include "spinlock.h"
 #include "uthread.h"
 
+/*
+ * On x86-64, contexts are switched by a hand-written routine that only saves
+ * callee-saved registers. Building with -DUTHREAD_CTX_UCONTEXT (`make
+ * CTX=ucontext`) falls back to the portable swapcontext() implementation.
+ */
+#if defined(__x86_64__) && !defined(UTHREAD_CTX_UCONTEXT)
+#define UTHREAD_CTX_ASM
+#else
+#include <ucontext.h>
+#endif
+
 /*
  * uthread_ctx_t - User-level thread context
  *
@@ -24,7 +38,15 @@
  * uthread_ctx_init(). Once initialized, it can be switched to with
  * uthread_ctx_switch().
  */
+#ifdef UTHREAD_CTX_ASM
+typedef struct uthread_ctx
+{
+	/* Saved stack pointer, all the other registers live on the stack */
+	void *sp;
+} uthread_ctx_t;
+#else
 typedef ucontext_t uthread_ctx_t;
+#endif
 
 /*
  * uthread_ctx_switch - Switch between two execution contexts
@@ -36,30 +58,39 @@ void uthread_ctx_switch(uthread_ctx_t *prev, uthread_ctx_t *next);
 
 /*
  * uthread_ctx_alloc_stack - Allocate stack segment
+ * @size: Size of the stack segment (in bytes)
+ *
+ * The segment is taken from the stack pool when possible, or freshly mapped
+ * otherwise. It is always preceded by a guard page, so that overflowing it
+ * faults right away.
  *
  * Return: Pointer to the top of a valid stack segment, or NULL in case of
  * failure
  */
-void *uthread_ctx_alloc_stack(void);
+void *uthread_ctx_alloc_stack(size_t size);
 
 /*
  * uthread_ctx_destroy_stack - Deallocate stack segment
  * @top_of_stack: Address of stack to deallocate
+ * @size: Size of the stack segment, as passed to uthread_ctx_alloc_stack()
+ *
+ * The segment is returned to the stack pool for later reuse.
  */
-void uthread_ctx_destroy_stack(void *top_of_stack);
+void uthread_ctx_destroy_stack(void *top_of_stack, size_t size);
 
 /*
  * uthread_ctx_init - Initialize a thread's execution context
  * @uctx: Pointer to thread context to initialize
  * @top_of_stack: Pointer to the top of a valid stack segment, as allocated by
  *	uthread_ctx_alloc_stack()
+ * @stack_size: Size of the stack segment
  * @func: Function to be executed by the thread
  * @arg: Argument to pass to the thread
  *
  * Return: 0 if @uctx was properly initialized, or -1 in case of failure
  */
 int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
-					 uthread_func_t func, void *arg);
+					 size_t stack_size, uthread_func_t func, void *arg);
 
 
 /**
@@ -68,15 +99,22 @@ int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
 
 /*
  * preempt_start - Start thread preemption
- * @preempt: Enable preemption if true
+ * @attr: Attributes given to uthread_run_attr()
+ *
+ * Configure a timer that must fire an alarm every @attr->quantum_us
+ * microseconds of @attr->clock, and setup a timer handler that forcefully
+ * yields the currently running thread. The timer is stopped when a tick finds
+ * no other thread ready to run, until preempt_ready() is called.
  *
- * Configure a timer that must fire a virtual alarm at a frequency of 100 Hz and
- * setup a timer handler that forcefully yields the currently running thread.
+ * The timer is the one of the calling worker, other workers set up their own
+ * with preempt_start_worker().
  *
- * If @preempt is false, don't start preemption; all the other functions from
- * the preemption API should then be ineffective.
+ * If @attr->preempt is false, don't start preemption; all the other functions
+ * from the preemption API should then be ineffective.
+ *
+ * Return: 0 in case of success, -1 if the timer couldn't be set up
  */
-void preempt_start(bool preempt);
+int preempt_start(const uthread_run_attr_t *attr);
 
 /*
  * preempt_stop - Stop thread preemption
@@ -86,16 +124,259 @@ void preempt_start(bool preempt);
  */
 void preempt_stop(void);
 
+/*
+ * preempt_start_worker - Start thread preemption on an additional worker
+ *
+ * Configure the timer of the calling worker, once preempt_start() was called.
+ *
+ * Return: 0 in case of success, -1 if the timer couldn't be set up
+ */
+int preempt_start_worker(void);
+
+/*
+ * preempt_stop_worker - Stop thread preemption on an additional worker
+ */
+void preempt_stop_worker(void);
+
+/*
+ * preempt_park - Notify that the calling worker is going to sleep
+ *
+ * Stop the timer of the worker until preempt_ready() is called.
+ */
+void preempt_park(void);
+
+/*
+ * preempt_ready - Notify that a thread was made ready to run
+ *
+ * Restart the timer if it was stopped because there was nothing else to run.
+ */
+void preempt_ready(void);
+
+/*
+ * preempt_quantum_us - Get the quantum given to preempt_start()
+ */
+unsigned int preempt_quantum_us(void);
+
 /*
  * preempt_enable - Enable preemption
+ *
+ * Undo one call to preempt_disable(). If a preemption tick arrived in the
+ * meantime and preemption gets fully enabled again, yield right away.
  */
 void preempt_enable(void);
 
 /*
  * preempt_disable - Disable preemption
+ *
+ * Calls can be nested, preemption is enabled again after the same number of
+ * calls to preempt_enable(). Context switches must happen exactly one level
+ * deep.
  */
 void preempt_disable(void);
 
+/**
+ * Private I/O API
+ */
+
+/*
+ * io_start - Set up the I/O poller
+ * @attr: Attributes given to uthread_run_attr()
+ *
+ * Return: 0 in case of success, -1 if the epoll instance couldn't be created
+ */
+int io_start(const uthread_run_attr_t *attr);
+
+/*
+ * io_stop - Tear down the I/O poller
+ */
+void io_stop(void);
+
+/*
+ * io_pending - Check whether threads are blocked on I/O or sleeping
+ */
+bool io_pending(void);
+
+/*
+ * io_waiter_add - Count the calling thread as blocked on I/O
+ *
+ * Must be called before the thread blocks, and paired with io_waiter_done().
+ */
+void io_waiter_add(void);
+
+/*
+ * io_waiter_done - Unblock a thread blocked on I/O
+ * @thread: Thread counted by io_waiter_add()
+ */
+void io_waiter_done(struct uthread_tcb *thread);
+
+/*
+ * io_flush - Submit the file I/O requests queued so far
+ *
+ * Must be called before a worker goes to sleep, since its threads may have
+ * queued requests that nobody would submit otherwise.
+ */
+void io_flush(void);
+
+/*
+ * io_poll - Unblock the threads whose I/O is ready
+ * @block: Sleep until some I/O is ready, or io_interrupt() is called
+ */
+void io_poll(bool block);
+
+/*
+ * io_poll_due - Count a schedule, and tell whether it's time to poll
+ * @schedules: Counter of the calling worker
+ *
+ * Threads blocked on I/O must be woken up even if workers never run out of
+ * ready threads, so busy workers poll every few schedules.
+ */
+bool io_poll_due(unsigned int *schedules);
+
+/*
+ * io_interrupt - Wake up the worker sleeping in io_poll(), if any
+ */
+void io_interrupt(void);
+
+/*
+ * uring_start - Set up the io_uring for file I/O
+ * @enable: Whether the io_uring should be used at all
+ *
+ * Return: File descriptor of the io_uring, readable once requests complete, or
+ * -1 if file I/O must go through the helper pool instead
+ */
+int uring_start(bool enable);
+
+/*
+ * uring_stop - Tear down the io_uring
+ */
+void uring_stop(void);
+
+/*
+ * uring_flush - Submit the queued requests
+ */
+void uring_flush(void);
+
+/*
+ * uring_reap - Unblock the threads whose requests completed
+ */
+void uring_reap(void);
+
+/**
+ * Private timer API
+ */
+
+/* Index of a timer that isn't pending */
+#define TIMER_NONE UINT32_MAX
+
+/*
+ * uthread_timer - Timer, usually embedded in a waiter
+ * @deadline: When the timer expires, in nanoseconds of CLOCK_MONOTONIC
+ * @index: Position in the timer heap, or TIMER_NONE
+ * @expire: Called by the poller once the timer expired, without locks held
+ */
+struct uthread_timer
+{
+	uint64_t deadline;
+	unsigned int index;
+	void (*expire)(struct uthread_timer *timer);
+};
+
+/*
+ * timer_start - Set up the timers
+ *
+ * Return: File descriptor readable once a timer expires, or -1 in case of
+ * failure
+ */
+int timer_start(void);
+
+/*
+ * timer_stop - Tear down the timers
+ */
+void timer_stop(void);
+
+/*
+ * timer_now - Current time, in nanoseconds of CLOCK_MONOTONIC
+ */
+uint64_t timer_now(void);
+
+/*
+ * timer_add - Start a timer
+ * @timer: Timer with @deadline and @expire set
+ *
+ * Return: 0 in case of success, -1 in case of failure (memory allocation)
+ */
+int timer_add(struct uthread_timer *timer);
+
+/*
+ * timer_cancel - Stop a timer
+ * @timer: Timer started with timer_add()
+ *
+ * Return: true if @timer was stopped, false if it already expired (its @expire
+ * function may still be running)
+ */
+bool timer_cancel(struct uthread_timer *timer);
+
+/*
+ * timer_expire - Run the timers that are due
+ */
+void timer_expire(void);
+
+/*
+ * timer_clear - Acknowledge that the timer file descriptor went off
+ */
+void timer_clear(void);
+
+/**
+ * Private helper pool API
+ */
+
+/*
+ * pool_job - Job run by a helper kernel thread
+ * @func: Function to run
+ * @arg: Argument of @func
+ * @thread: Thread waiting for the job
+ * @lock: Held by @thread until it is switched out
+ * @node: Node in the queue of pending or done jobs
+ */
+struct pool_job
+{
+	void (*func)(void *arg);
+	void *arg;
+	struct uthread_tcb *thread;
+	spinlock_t lock;
+	struct iqueue_node node;
+};
+
+/*
+ * pool_start - Set up the helper pool
+ * @helpers: Number of helper kernel threads
+ *
+ * Helpers are only started when the first job is submitted.
+ *
+ * Return: File descriptor readable once jobs are done, or -1 in case of failure
+ */
+int pool_start(unsigned int helpers);
+
+/*
+ * pool_stop - Stop the helpers
+ */
+void pool_stop(void);
+
+/*
+ * pool_run - Run a job on a helper
+ * @job: Job to run, with @func and @arg set
+ *
+ * Block the calling thread until @job is done.
+ *
+ * Return: 0 once @job is done, or -1 if no helper could be started
+ */
+int pool_run(struct pool_job *job);
+
+/*
+ * pool_reap - Unblock the threads whose jobs are done
+ */
+void pool_reap(void);
+
 
 /**
  * Private uthread API
@@ -107,6 +388,78 @@ void preempt_disable(void);
  */
 struct uthread_tcb;
 
+/*
+ * uthread_waiter - Thread waiting in a wait queue
+ * @node: Link in the wait queue
+ * @thread: Waiting thread
+ *
+ * Wait queues of synchronization objects are intrusive queues of waiters. A
+ * waiter lives on the stack of the thread that blocks, so waiting never
+ * allocates memory, and the waiter stays valid until the thread is unblocked.
+ */
+struct uthread_waiter
+{
+	struct iqueue_node node;
+	struct uthread_tcb *thread;
+};
+
+/*
+ * sched_entity - Scheduling state of a thread
+ * @node: Link in the ready queue
+ * @priority: Priority given at creation or by uthread_set_priority()
+ * @weight: Weight given at creation
+ * @level: Ready queue the thread goes in (MLFQ)
+ * @boost_epoch: Last priority boost the thread got (MLFQ)
+ * @runtime: CPU time used (in ns) at the current level (MLFQ)
+ * @vruntime: CPU time used (in ns) scaled by the weight (fair)
+ * @ready_seq: Order in which the thread was made ready, breaking ties (fair)
+ * @data: Slot of custom policies, see uthread_sched_data()
+ *
+ * Each TCB embeds one, for the built-in policies to use.
+ */
+struct sched_entity
+{
+	struct iqueue_node node;
+	int priority;
+	unsigned int weight;
+	unsigned int level;
+	unsigned int boost_epoch;
+	uint64_t runtime;
+	uint64_t vruntime;
+	uint64_t ready_seq;
+	void *data;
+};
+
+/*
+ * uthread_sched_entity - Get the scheduling state of a thread
+ * @thread: Thread to get the scheduling state of
+ */
+struct sched_entity *uthread_sched_entity(struct uthread_tcb *thread);
+
+/*
+ * sched_entity_thread - Get the thread of a scheduling state
+ * @se: Scheduling state, as returned by uthread_sched_entity()
+ */
+struct uthread_tcb *sched_entity_thread(struct sched_entity *se);
+
+/* Built-in scheduling policies, see uthread_sched_t */
+extern const uthread_sched_ops_t sched_fifo_ops;
+extern const uthread_sched_ops_t sched_lifo_ops;
+extern const uthread_sched_ops_t sched_mlfq_ops;
+extern const uthread_sched_ops_t sched_fair_ops;
+
+/*
+ * fifo_enqueue_ready_all - Make a whole queue of threads ready (FIFO)
+ * @threads: Queue of the threads' sched_entity nodes, left empty
+ */
+void fifo_enqueue_ready_all(struct iqueue *threads);
+
+/*
+ * fifo_enqueue_ready_next - Make a thread ready, to run next (FIFO)
+ * @thread: Thread to put at the front of the ready queue
+ */
+void fifo_enqueue_ready_next(uthread_t thread);
+
 /*
  * uthread_current - Get currently running thread
  *
@@ -114,15 +467,243 @@ struct uthread_tcb;
  */
 struct uthread_tcb *uthread_current(void);
 
+/*
+ * uthread_has_ready - Check whether any thread is waiting to run
+ *
+ * Return: true if the ready queue is not empty
+ */
+bool uthread_has_ready(void);
+
+/*
+ * uthread_preempt - Forcefully yield the currently running thread
+ *
+ * Same as uthread_yield(), for a thread that used up its whole quantum.
+ */
+void uthread_preempt(void);
+
+/*
+ * uthread_finish_switch - Complete a context switch
+ *
+ * Must be called by a thread right after it gets switched to, including when it
+ * runs for the first time, to clean up after the thread it replaced (e.g.,
+ * collect it if it exited).
+ */
+void uthread_finish_switch(void);
+
 /*
  * uthread_block - Block currently running thread
+ * @lock: Lock protecting the wait queue the thread was put in, or NULL
+ *
+ * The thread is not scheduled again until uthread_unblock() is called on it.
+ * Must be called with preemption disabled (once).
+ *
+ * @lock must be held by the caller, and is released once the thread is
+ * switched out: another worker can't unblock the thread before its context is
+ * saved.
  */
-void uthread_block(void);
+void uthread_block(spinlock_t *lock);
 
 /*
  * uthread_unblock - Unblock thread
  * @uthread: TCB of thread to unblock
+ *
+ * Put @uthread back in the ready queue.
  */
 void uthread_unblock(struct uthread_tcb *uthread);
 
+/*
+ * uthread_unblock_next - Unblock thread, to run it next
+ * @uthread: TCB of thread to unblock
+ *
+ * Like uthread_unblock(), but with FIFO scheduling and a single worker,
+ * @uthread goes to the front of the ready queue, e.g. because it was just
+ * handed data that is still hot in the cache. To let the other threads run,
+ * one in HANDOFF_MAX threads still goes to the back.
+ */
+void uthread_unblock_next(struct uthread_tcb *uthread);
+
+/*
+ * uthread_unblock_all - Unblock a queue of threads
+ * @threads: Queue of blocked threads, linked by their sched_entity nodes
+ *
+ * Same as calling uthread_unblock() on each thread in order, but with several
+ * workers or FIFO scheduling the whole queue is moved to the ready queue at
+ * once, in O(1). @threads is left empty.
+ */
+void uthread_unblock_all(struct iqueue *threads);
+
+/**
+ * Private select API
+ */
+
+struct semaphore;
+struct channel;
+
+/*
+ * select_wait - Thread blocked in uthread_select()
+ * @lock: Held by the thread until it is switched out
+ * @thread: Selecting thread
+ * @winner: Index of the case that completed, -1 until one does
+ *
+ * The thread waits in the queue of every case at once. Whoever completes a
+ * case for it must first claim it with select_claim(), with the lock of the
+ * case's queue held, and then wake it up with select_wake(). The thread's
+ * registrations in the other queues are then stale: they stay queued, skipped
+ * by whoever finds them, until the thread removes them once it runs again, so
+ * that their objects can't be destroyed before.
+ */
+struct select_wait
+{
+	spinlock_t lock;
+	struct uthread_tcb *thread;
+	int winner;
+};
+
+/*
+ * select_claim - Complete a case of a select
+ * @sel: Select waiting for the case
+ * @index: Index of the case
+ *
+ * Return: true if @sel is now won by case @index, false if another case
+ * already won it
+ */
+bool select_claim(struct select_wait *sel, unsigned int index);
+
+/*
+ * select_decided - Whether a case of a select already won it
+ * @sel: Select to check
+ */
+bool select_decided(struct select_wait *sel);
+
+/*
+ * select_wake - Unblock the thread of a select claimed with select_claim()
+ * @sel: Claimed select, whose queue lock must not be held
+ * @next: Whether to run it next, see uthread_unblock_next()
+ */
+void select_wake(struct select_wait *sel, bool next);
+
+/*
+ * sem_waiter - Thread waiting for a semaphore, possibly with a timeout or in
+ * a select
+ * @waiter: Link in the wait queue of @sem
+ * @timer: Timeout, if @timed
+ * @sem: Semaphore waited for
+ * @needed: Resources to take
+ * @timed: Whether the thread gives up at @timer's deadline
+ * @timed_out: Set if the thread gave up
+ * @select: Select the waiter belongs to, or NULL
+ * @index: Index of the case in @select
+ *
+ * Waiters are served in order: the oldest one gets its @needed resources
+ * before anyone behind it, so that large requests don't starve.
+ *
+ * Whoever takes the waiter out of the wait queue decides how it wakes up: with
+ * the resources (sem_up_n()) or without (the timeout). If sem_up_n() finds
+ * that the timer already expired, the timeout wakes the thread up with the
+ * resources instead.
+ */
+struct sem_waiter
+{
+	struct uthread_waiter waiter;
+	struct uthread_timer timer;
+	struct semaphore *sem;
+	size_t needed;
+	bool timed;
+	bool timed_out;
+	struct select_wait *select;
+	unsigned int index;
+};
+
+/*
+ * sem_select_lock - Lock of a semaphore
+ * @sem: Semaphore of a select case
+ */
+spinlock_t *sem_select_lock(struct semaphore *sem);
+
+/*
+ * sem_select_try - Take a resource from a semaphore without waiting, with its
+ * lock held
+ * @sem: Semaphore to take
+ *
+ * Return: true if a resource was taken
+ */
+bool sem_select_try(struct semaphore *sem);
+
+/*
+ * sem_select_wait - Enqueue a select waiter, with the lock held
+ * @sem: Semaphore to wait for
+ * @w: Waiter with @select and @index set
+ */
+void sem_select_wait(struct semaphore *sem, struct sem_waiter *w);
+
+/*
+ * sem_select_cancel - Remove a select waiter if it is still queued, with the
+ * lock held
+ * @sem: Semaphore waited for
+ * @w: Waiter enqueued with sem_select_wait()
+ */
+void sem_select_cancel(struct semaphore *sem, struct sem_waiter *w);
+
+/*
+ * chan_waiter - Thread waiting to send to or receive from a channel
+ * @waiter: Link in the senders or receivers queue
+ * @msg: Message to send, or where to copy the message received
+ * @status: Result of the operation, set by whoever dequeued the waiter
+ * @select: Select the waiter belongs to, or NULL
+ * @index: Index of the case in @select
+ */
+struct chan_waiter
+{
+	struct uthread_waiter waiter;
+	void *msg;
+	int status;
+	struct select_wait *select;
+	unsigned int index;
+};
+
+/*
+ * chan_select_lock - Lock of a channel
+ * @chan: Channel of a select case
+ */
+spinlock_t *chan_select_lock(struct channel *chan);
+
+/*
+ * chan_select_try - Send or receive without waiting, with the lock held
+ * @chan: Channel to send to or receive from
+ * @send: Whether to send
+ * @msg: Message to send, or where to copy the message received
+ * @status: Set to the result of the operation, if done
+ * @peer: Set to the waiter that took part, to wake up with chan_wake() once
+ *	the lock is released (to run next if @send), or NULL
+ *
+ * Return: true if the operation is done
+ */
+bool chan_select_try(struct channel *chan, bool send, void *msg, int *status,
+					 struct chan_waiter **peer);
+
+/*
+ * chan_select_wait - Enqueue a select waiter, with the lock held
+ * @chan: Channel to send to or receive from
+ * @send: Whether to send
+ * @w: Waiter with @msg, @select and @index set
+ */
+void chan_select_wait(struct channel *chan, bool send, struct chan_waiter *w);
+
+/*
+ * chan_select_cancel - Remove a select waiter if it is still queued, with the
+ * lock held
+ * @chan: Channel waited for
+ * @send: Whether @w waits to send
+ * @w: Waiter enqueued with chan_select_wait()
+ */
+void chan_select_cancel(struct channel *chan, bool send,
+						struct chan_waiter *w);
+
+/*
+ * chan_wake - Unblock a waiter dequeued from a channel
+ * @w: Waiter whose operation is done
+ * @next: Whether to run it next, see uthread_unblock_next()
+ */
+void chan_wake(struct chan_waiter *w, bool next);
+
 #endif /* _UTHREAD_PRIVATE_H */
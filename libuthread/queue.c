@@ -11,6 +11,8 @@ typedef struct node
 	node_t next_node;
 	node_t prev_node;
 	void *data;
+	// generation of the queue when the item was enqueued
+	unsigned long generation;
 } node;
 
 typedef struct queue
@@ -19,9 +21,26 @@ typedef struct queue
 	unsigned int length;
 	node_t head;
 	node_t tail;
+
+	// nodes of removed items, recycled by later enqueues
+	node_t free_nodes;
+
+	// bumped by each queue_iterate(), so that it can tell enqueued items apart
+	unsigned long generation;
 } queue;
 
+static void recycle_node(queue_t queue, node_t old_node)
+{
+	old_node->next_node = queue->free_nodes;
+	queue->free_nodes = old_node;
+}
+
 queue_t queue_create(void)
+{
+	return queue_create_capacity(0);
+}
+
+queue_t queue_create_capacity(unsigned int capacity)
 {
 	/* TODO Phase 1 */
 	queue_t new_queue = malloc(sizeof(queue));
@@ -33,6 +52,21 @@ queue_t queue_create(void)
 	new_queue->length = 0;
 	new_queue->head = NULL;
 	new_queue->tail = NULL;
+	new_queue->free_nodes = NULL;
+	new_queue->generation = 0;
+
+	// preallocate nodes, enqueue picks them from the free list
+	for (unsigned int i = 0; i < capacity; i++)
+	{
+		node_t new_node = malloc(sizeof(node));
+
+		if (new_node == NULL)
+		{
+			queue_destroy(new_queue);
+			return NULL;
+		}
+		recycle_node(new_queue, new_node);
+	}
 
 	return new_queue;
 }
@@ -44,6 +78,13 @@ int queue_destroy(queue_t queue)
 		return -1;
 	}
 
+	while (queue->free_nodes != NULL)
+	{
+		node_t next = queue->free_nodes->next_node;
+		free(queue->free_nodes);
+		queue->free_nodes = next;
+	}
+
 	free(queue);
 	return 0;
 }
@@ -55,15 +96,25 @@ int queue_enqueue(queue_t queue, void *data)
 		return -1;
 	}
 
-	// create new node
-	node_t new_node = malloc(sizeof(node));
+	// create new node, reusing a previously removed one if possible
+	node_t new_node = queue->free_nodes;
 
-	if (new_node == NULL)
+	if (new_node != NULL)
 	{
-		return -1;
+		queue->free_nodes = new_node->next_node;
+	}
+	else
+	{
+		new_node = malloc(sizeof(node));
+
+		if (new_node == NULL)
+		{
+			return -1;
+		}
 	}
 
 	new_node->data = data;
+	new_node->generation = queue->generation;
 	new_node->next_node = NULL;
 	new_node->prev_node = NULL;
 
@@ -95,9 +146,14 @@ int queue_dequeue(queue_t queue, void **data)
 	*data = dequeued_node->data;
 
 	queue->head = queue->head->next_node;
+	if (queue->head != NULL)
+	{
+		// the old head is about to be recycled, don't keep pointing to it
+		queue->head->prev_node = NULL;
+	}
 	queue->length--;
 
-	free(dequeued_node);
+	recycle_node(queue, dequeued_node);
 
 	return 0;
 }
@@ -138,7 +194,7 @@ int queue_delete(queue_t queue, void *data)
 				queue->tail = current->prev_node;
 			}
 
-			free(current);
+			recycle_node(queue, current);
 
 			queue->length--;
 
@@ -157,9 +213,12 @@ int queue_iterate(queue_t queue, queue_func_t func)
 		return -1;
 	}
 
+	// items enqueued by the provided function, even in a recycled node, get
+	// this generation or a later one and aren't visited
+	unsigned long generation = ++queue->generation;
 	node_t current = queue->head;
 
-	while (current != NULL)
+	while (current != NULL && current->generation < generation)
 	{
 		// Need to save in case the provided function removes our current node
 		node_t next = current->next_node;
@@ -22,6 +22,19 @@ typedef struct queue *queue_t;
  */
 queue_t queue_create(void);
 
+/*
+ * queue_create_capacity - Allocate an empty queue with preallocated storage
+ * @capacity: Number of items the queue can hold before growing
+ *
+ * Same as queue_create(), but storage for at least @capacity items is
+ * allocated right away, so that enqueueing up to @capacity items never
+ * allocates memory.
+ *
+ * Return: Pointer to new empty queue. NULL if @capacity is too large, or in
+ * case of failure when allocating the new queue.
+ */
+queue_t queue_create_capacity(unsigned int capacity);
+
 /*
  * queue_destroy - Deallocate a queue
  * @queue: Queue to deallocate
@@ -91,7 +104,8 @@ typedef void (*queue_func_t)(queue_t queue, void *data);
  * item. The callback function receives the current data item as parameter.
  *
  * Note that this function should be resistant to data items being deleted
- * as part of the iteration (ie in @func).
+ * as part of the iteration (ie in @func). Items enqueued by @func are not
+ * visited.
  *
  * Return: -1 if @queue or @func are NULL, 0 otherwise.
  */
@@ -0,0 +1,263 @@
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "queue.h"
+
+/* Capacity of a queue when it first needs to store items */
+#define QUEUE_DEFAULT_CAPACITY 16
+
+/* Largest power of two capacity */
+#define QUEUE_MAX_CAPACITY (UINT_MAX / 2 + 1)
+
+/*
+ * Ring buffer implementation of the queue API
+ *
+ * Items are stored contiguously in a power-of-two sized array, starting at
+ * index head and wrapping around. The array doubles in size when full, so
+ * enqueueing is amortized O(1) and never allocates once the queue has reached
+ * its working size.
+ */
+typedef struct queue
+{
+	void **items;
+	unsigned int head;
+	unsigned int length;
+	unsigned int capacity;
+
+	// logical index of the next item queue_iterate() visits, and of the item
+	// past the last one it visits
+	bool iterating;
+	unsigned int iter_next;
+	unsigned int iter_end;
+} queue;
+
+// physical position of the item at logical index @index
+static inline unsigned int slot(queue_t queue, unsigned int index)
+{
+	return (queue->head + index) & (queue->capacity - 1);
+}
+
+static int grow(queue_t queue, unsigned int capacity)
+{
+	void **items = malloc(capacity * sizeof(void *));
+
+	if (items == NULL)
+	{
+		return -1;
+	}
+
+	// unwrap the items at the start of the new array
+	for (unsigned int i = 0; i < queue->length; i++)
+	{
+		items[i] = queue->items[slot(queue, i)];
+	}
+
+	free(queue->items);
+	queue->items = items;
+	queue->head = 0;
+	queue->capacity = capacity;
+
+	return 0;
+}
+
+queue_t queue_create(void)
+{
+	return queue_create_capacity(0);
+}
+
+queue_t queue_create_capacity(unsigned int capacity)
+{
+	if (capacity > QUEUE_MAX_CAPACITY)
+	{
+		return NULL;
+	}
+
+	queue_t new_queue = malloc(sizeof(queue));
+	if (new_queue == NULL)
+	{
+		return NULL;
+	}
+
+	new_queue->items = NULL;
+	new_queue->head = 0;
+	new_queue->length = 0;
+	new_queue->capacity = 0;
+	new_queue->iterating = false;
+	new_queue->iter_next = 0;
+	new_queue->iter_end = 0;
+
+	if (capacity > 0)
+	{
+		// round up to a power of two
+		unsigned int rounded = 1;
+		while (rounded < capacity)
+		{
+			rounded <<= 1;
+		}
+
+		if (grow(new_queue, rounded) == -1)
+		{
+			free(new_queue);
+			return NULL;
+		}
+	}
+
+	return new_queue;
+}
+
+int queue_destroy(queue_t queue)
+{
+	if (queue == NULL || queue->length > 0)
+	{
+		return -1;
+	}
+
+	free(queue->items);
+	free(queue);
+	return 0;
+}
+
+int queue_enqueue(queue_t queue, void *data)
+{
+	if (queue == NULL || data == NULL)
+	{
+		return -1;
+	}
+
+	if (queue->length == queue->capacity)
+	{
+		if (queue->capacity == QUEUE_MAX_CAPACITY)
+		{
+			return -1;
+		}
+
+		unsigned int capacity = queue->capacity ? queue->capacity * 2
+												: QUEUE_DEFAULT_CAPACITY;
+		if (grow(queue, capacity) == -1)
+		{
+			return -1;
+		}
+	}
+
+	queue->items[slot(queue, queue->length)] = data;
+	queue->length++;
+
+	return 0;
+}
+
+int queue_dequeue(queue_t queue, void **data)
+{
+	if (queue == NULL || queue->length == 0 || data == NULL)
+	{
+		return -1;
+	}
+
+	*data = queue->items[queue->head];
+	queue->head = slot(queue, 1);
+	queue->length--;
+
+	// keep the iteration on the same items, now one position closer to the head
+	if (queue->iterating)
+	{
+		if (queue->iter_next > 0)
+		{
+			queue->iter_next--;
+		}
+		if (queue->iter_end > 0)
+		{
+			queue->iter_end--;
+		}
+	}
+
+	return 0;
+}
+
+int queue_delete(queue_t queue, void *data)
+{
+	if (queue == NULL || data == NULL)
+	{
+		return -1;
+	}
+
+	for (unsigned int i = 0; i < queue->length; i++)
+	{
+		if (queue->items[slot(queue, i)] != data)
+		{
+			continue;
+		}
+
+		// close the gap by moving whichever side of the item is shorter
+		if (i < queue->length / 2)
+		{
+			for (unsigned int j = i; j > 0; j--)
+			{
+				queue->items[slot(queue, j)] = queue->items[slot(queue, j - 1)];
+			}
+			queue->head = slot(queue, 1);
+		}
+		else
+		{
+			for (unsigned int j = i; j + 1 < queue->length; j++)
+			{
+				queue->items[slot(queue, j)] = queue->items[slot(queue, j + 1)];
+			}
+		}
+		queue->length--;
+
+		// items after the deleted one all moved one position closer to the head
+		if (queue->iterating && queue->iter_next > i)
+		{
+			queue->iter_next--;
+		}
+		if (queue->iterating && queue->iter_end > i)
+		{
+			queue->iter_end--;
+		}
+
+		return 0;
+	}
+
+	return -1;
+}
+
+int queue_iterate(queue_t queue, queue_func_t func)
+{
+	if (queue == NULL || func == NULL)
+	{
+		return -1;
+	}
+
+	// the indexes are kept in the queue so deletions from @func can adjust
+	// them, and items enqueued by @func are past the end
+	bool saved_iterating = queue->iterating;
+	unsigned int saved_next = queue->iter_next;
+	unsigned int saved_end = queue->iter_end;
+
+	queue->iterating = true;
+	queue->iter_next = 0;
+	queue->iter_end = queue->length;
+
+	while (queue->iter_next < queue->iter_end)
+	{
+		func(queue, queue->items[slot(queue, queue->iter_next++)]);
+	}
+
+	queue->iterating = saved_iterating;
+	queue->iter_next = saved_next;
+	queue->iter_end = saved_end;
+
+	return 0;
+}
+
+int queue_length(queue_t queue)
+{
+	if (queue == NULL)
+	{
+		return -1;
+	}
+
+	return queue->length;
+}
@@ -0,0 +1,255 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "iqueue.h"
+#include "private.h"
+#include "rwlock.h"
+#include "spinlock.h"
+
+/*
+ * Lock state
+ *
+ * The state holds the number of readers, whether a writer holds the lock, and
+ * whether threads wait for it. Without waiters, taking and releasing the lock
+ * only change the state with a compare-and-swap. Once RW_WAITING is set, the
+ * state only changes under the spinlock, which also protects the waiter
+ * queues: an unlock then hands the lock over to waiters directly, counting
+ * them in the state before unblocking them.
+ *
+ * Waiters are linked by the ready queue node of their sched_entity, like with
+ * condition variables, so that all the readers can be unblocked at once with
+ * uthread_unblock_all().
+ */
+#define RW_WRITER (1u << 31)
+#define RW_WAITING (1u << 30)
+#define RW_READERS (RW_WAITING - 1)
+
+static bool state_cas(uthread_rwlock_t *rwlock, unsigned int *state,
+					  unsigned int new_state)
+{
+	return __atomic_compare_exchange_n(&rwlock->state, state, new_state, false,
+									   __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+// statically initialized locks get their queues on first contention
+static void lazy_init(uthread_rwlock_t *rwlock)
+{
+	if (rwlock->readers.head.next == NULL)
+	{
+		iqueue_init(&rwlock->readers);
+		iqueue_init(&rwlock->writers);
+	}
+}
+
+// Whether a new reader can get in, with the spinlock held
+static bool read_allowed(uthread_rwlock_t *rwlock, unsigned int state)
+{
+	return !(state & RW_WRITER) &&
+		   !(rwlock->prefer_writers && iqueue_length(&rwlock->writers) > 0);
+}
+
+int uthread_rwlock_init(uthread_rwlock_t *rwlock, bool prefer_writers)
+{
+	if (rwlock == NULL)
+	{
+		return -1;
+	}
+
+	*rwlock = (uthread_rwlock_t)UTHREAD_RWLOCK_INITIALIZER;
+	rwlock->prefer_writers = prefer_writers;
+
+	return 0;
+}
+
+/*
+ * rwlock_lock - Take a lock, waiting for it if @wait
+ *
+ * Return: 0 if the lock is taken, -1 if it would have to wait
+ */
+static int rwlock_lock(uthread_rwlock_t *rwlock, bool write, bool wait)
+{
+	unsigned int state = __atomic_load_n(&rwlock->state, __ATOMIC_RELAXED);
+
+	// fast path, nobody waits
+	while (!(state & (RW_WRITER | RW_WAITING)))
+	{
+		if (write && state != 0)
+		{
+			break;
+		}
+
+		if (state_cas(rwlock, &state, write ? RW_WRITER : state + 1))
+		{
+			return 0;
+		}
+	}
+
+	if (!wait && (write || (state & RW_WRITER)))
+	{
+		return -1;
+	}
+
+	preempt_disable();
+	spin_lock(&rwlock->lock);
+	lazy_init(rwlock);
+
+	state = __atomic_load_n(&rwlock->state, __ATOMIC_RELAXED);
+	for (;;)
+	{
+		bool allowed = write ? (state & ~RW_WAITING) == 0
+							 : read_allowed(rwlock, state);
+
+		if (allowed)
+		{
+			if (state_cas(rwlock, &state,
+						  write ? state | RW_WRITER : state + 1))
+			{
+				spin_unlock(&rwlock->lock);
+				preempt_enable();
+				return 0;
+			}
+		}
+		else if (!wait)
+		{
+			spin_unlock(&rwlock->lock);
+			preempt_enable();
+			return -1;
+		}
+		else if (state_cas(rwlock, &state, state | RW_WAITING))
+		{
+			// the state can't change under us anymore
+			break;
+		}
+	}
+
+	// the lock is handed over to us, see uthread_rwlock_unlock()
+	iqueue_enqueue(write ? &rwlock->writers : &rwlock->readers,
+				   &uthread_sched_entity(uthread_current())->node);
+	uthread_block(&rwlock->lock);
+
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_rwlock_rdlock(uthread_rwlock_t *rwlock)
+{
+	if (rwlock == NULL)
+	{
+		return -1;
+	}
+
+	return rwlock_lock(rwlock, false, true);
+}
+
+int uthread_rwlock_wrlock(uthread_rwlock_t *rwlock)
+{
+	if (rwlock == NULL)
+	{
+		return -1;
+	}
+
+	return rwlock_lock(rwlock, true, true);
+}
+
+int uthread_rwlock_tryrdlock(uthread_rwlock_t *rwlock)
+{
+	if (rwlock == NULL)
+	{
+		return -1;
+	}
+
+	return rwlock_lock(rwlock, false, false);
+}
+
+int uthread_rwlock_trywrlock(uthread_rwlock_t *rwlock)
+{
+	if (rwlock == NULL)
+	{
+		return -1;
+	}
+
+	return rwlock_lock(rwlock, true, false);
+}
+
+int uthread_rwlock_unlock(uthread_rwlock_t *rwlock)
+{
+	if (rwlock == NULL)
+	{
+		return -1;
+	}
+
+	unsigned int state = __atomic_load_n(&rwlock->state, __ATOMIC_RELAXED);
+
+#ifdef UTHREAD_DEBUG
+	if ((state & ~RW_WAITING) == 0)
+	{
+		fprintf(stderr, "uthread_rwlock: unlocking a lock that isn't held\n");
+		abort();
+	}
+#endif
+
+	// fast path, nobody waits
+	while (!(state & RW_WAITING))
+	{
+		if (state_cas(rwlock, &state, (state & RW_WRITER) ? 0 : state - 1))
+		{
+			return 0;
+		}
+	}
+
+	preempt_disable();
+	spin_lock(&rwlock->lock);
+
+	// RW_WAITING is set, so only we can change the state now
+	state = __atomic_load_n(&rwlock->state, __ATOMIC_RELAXED);
+
+	unsigned int new_state = (state & RW_WRITER) ? state & ~RW_WRITER
+												 : state - 1;
+	unsigned int nreaders = iqueue_length(&rwlock->readers);
+	unsigned int nwriters = iqueue_length(&rwlock->writers);
+	struct iqueue woken;
+	struct uthread_tcb *writer = NULL;
+
+	iqueue_init(&woken);
+
+	if ((new_state & RW_READERS) == 0)
+	{
+		// Waiting readers go first after a writer, so neither side starves
+		if (nreaders > 0 && ((state & RW_WRITER) || nwriters == 0))
+		{
+			new_state += nreaders;
+			iqueue_splice(&woken, &rwlock->readers);
+			nreaders = 0;
+		}
+		else if (nwriters > 0)
+		{
+			struct iqueue_node *node = iqueue_dequeue(&rwlock->writers);
+
+			writer = sched_entity_thread(
+				iqueue_entry(node, struct sched_entity, node));
+			new_state |= RW_WRITER;
+			nwriters--;
+		}
+	}
+
+	if (nreaders == 0 && nwriters == 0)
+	{
+		new_state &= ~RW_WAITING;
+	}
+
+	__atomic_store_n(&rwlock->state, new_state, __ATOMIC_RELEASE);
+	spin_unlock(&rwlock->lock);
+
+	if (writer != NULL)
+	{
+		uthread_unblock(writer);
+	}
+	uthread_unblock_all(&woken);
+
+	preempt_enable();
+
+	return 0;
+}
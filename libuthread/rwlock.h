@@ -0,0 +1,96 @@
+#ifndef _UTHREAD_RWLOCK_H
+#define _UTHREAD_RWLOCK_H
+
+#include <stdbool.h>
+
+#include "iqueue.h"
+#include "spinlock.h"
+
+/*
+ * uthread_rwlock_t - Reader-writer lock type
+ *
+ * A reader-writer lock is held either by any number of readers at the same
+ * time, or by a single writer. Taking or releasing a lock nobody waits for is
+ * a single atomic operation.
+ *
+ * When a writer unlocks, all the readers waiting are let in at once, and
+ * writers otherwise get the lock in order. By default, new readers get in as
+ * long as other readers hold the lock, even if a writer waits, which gives the
+ * most read throughput but lets a steady stream of readers starve writers.
+ * With writer preference, new readers wait behind waiting writers.
+ *
+ * The fields are private to the library.
+ */
+typedef struct uthread_rwlock
+{
+	unsigned int state;
+	bool prefer_writers;
+	spinlock_t lock;
+	struct iqueue readers;
+	struct iqueue writers;
+} uthread_rwlock_t;
+
+/* Static initializers of an unlocked lock, without and with writer preference */
+#define UTHREAD_RWLOCK_INITIALIZER {0}
+#define UTHREAD_RWLOCK_WRITER_INITIALIZER {.prefer_writers = true}
+
+/*
+ * uthread_rwlock_init - Initialize an unlocked reader-writer lock
+ * @rwlock: Lock to initialize
+ * @prefer_writers: Whether waiting writers go before new readers
+ *
+ * A reader-writer lock doesn't need to be destroyed.
+ *
+ * Return: -1 if @rwlock is NULL. 0 otherwise.
+ */
+int uthread_rwlock_init(uthread_rwlock_t *rwlock, bool prefer_writers);
+
+/*
+ * uthread_rwlock_rdlock - Lock a reader-writer lock for reading
+ * @rwlock: Lock to take
+ *
+ * If a writer holds @rwlock (or waits for it, with writer preference), the
+ * caller thread is blocked until it is let in.
+ *
+ * Return: -1 if @rwlock is NULL. 0 once the caller is one of the readers.
+ */
+int uthread_rwlock_rdlock(uthread_rwlock_t *rwlock);
+
+/*
+ * uthread_rwlock_wrlock - Lock a reader-writer lock for writing
+ * @rwlock: Lock to take
+ *
+ * If @rwlock is held, the caller thread is blocked until it is its turn.
+ *
+ * Return: -1 if @rwlock is NULL. 0 once the caller is the writer.
+ */
+int uthread_rwlock_wrlock(uthread_rwlock_t *rwlock);
+
+/*
+ * uthread_rwlock_tryrdlock - Lock a reader-writer lock for reading, without
+ * waiting
+ * @rwlock: Lock to take
+ *
+ * Return: -1 if @rwlock is NULL or the caller would have to wait. 0 if the
+ * caller is now one of the readers.
+ */
+int uthread_rwlock_tryrdlock(uthread_rwlock_t *rwlock);
+
+/*
+ * uthread_rwlock_trywrlock - Lock a reader-writer lock for writing, without
+ * waiting
+ * @rwlock: Lock to take
+ *
+ * Return: -1 if @rwlock is NULL or held. 0 if the caller is now the writer.
+ */
+int uthread_rwlock_trywrlock(uthread_rwlock_t *rwlock);
+
+/*
+ * uthread_rwlock_unlock - Unlock a reader-writer lock
+ * @rwlock: Lock held by the caller, for reading or writing
+ *
+ * Return: -1 if @rwlock is NULL. 0 otherwise.
+ */
+int uthread_rwlock_unlock(uthread_rwlock_t *rwlock);
+
+#endif /* _UTHREAD_RWLOCK_H */
@@ -0,0 +1,213 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "private.h"
+#include "uthread.h"
+
+/* Initial capacity of the ready heap */
+#define READY_HEAP_DEFAULT_CAPACITY 64
+
+/*
+ * Fair share policy
+ *
+ * Ready threads are kept in a binary min-heap ordered by virtual runtime. The
+ * heap array always has room for every thread, so enqueueing never fails.
+ */
+static struct sched_entity **ready_heap;
+static unsigned int ready_heap_len;
+static unsigned int ready_heap_cap;
+
+// Number of threads created and not exited yet
+static unsigned int live_threads;
+
+// vruntime of the last thread picked, which new and woken up threads start
+// from, and when the running thread got the CPU
+static uint64_t min_vruntime;
+static uint64_t next_ready_seq;
+static uint64_t run_start;
+
+// CPU time of the worker, which only ever runs one thread at a time (fair
+// scheduling is single-worker), so that time the kernel took the CPU away
+// isn't charged to the running thread
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Charge the running thread for the CPU time it used since it was scheduled
+static void charge(struct sched_entity *se)
+{
+	uint64_t now = now_ns();
+
+	se->vruntime += (now - run_start) * UTHREAD_WEIGHT_DEFAULT / se->weight;
+	run_start = now;
+}
+
+static bool runs_before(const struct sched_entity *a,
+						const struct sched_entity *b)
+{
+	if (a->vruntime != b->vruntime)
+	{
+		return a->vruntime < b->vruntime;
+	}
+
+	return a->ready_seq < b->ready_seq;
+}
+
+static int fair_init(void)
+{
+	ready_heap_len = 0;
+	live_threads = 0;
+	min_vruntime = 0;
+	next_ready_seq = 0;
+	run_start = now_ns();
+
+	return 0;
+}
+
+static void fair_fini(void)
+{
+	free(ready_heap);
+	ready_heap = NULL;
+	ready_heap_cap = 0;
+}
+
+static int fair_on_create(uthread_t thread, const uthread_attr_t *attr)
+{
+	struct sched_entity *se = uthread_sched_entity(thread);
+
+	// Make room in the heap for every thread, including this one
+	if (live_threads + 1 > ready_heap_cap)
+	{
+		unsigned int cap = ready_heap_cap ? ready_heap_cap * 2
+										  : READY_HEAP_DEFAULT_CAPACITY;
+		struct sched_entity **heap =
+			realloc(ready_heap, cap * sizeof(struct sched_entity *));
+
+		if (heap == NULL)
+		{
+			return -1;
+		}
+
+		ready_heap = heap;
+		ready_heap_cap = cap;
+	}
+
+	live_threads++;
+	se->weight = attr->weight;
+	se->vruntime = min_vruntime;
+
+	return 0;
+}
+
+static void fair_enqueue_ready(uthread_t thread)
+{
+	struct sched_entity *se = uthread_sched_entity(thread);
+
+	if (thread == uthread_current())
+	{
+		charge(se);
+	}
+
+	// Threads that were blocked don't get to catch up on the time they didn't
+	// use, they would monopolize the CPU
+	if (se->vruntime < min_vruntime)
+	{
+		se->vruntime = min_vruntime;
+	}
+
+	se->ready_seq = next_ready_seq++;
+
+	// sift up
+	unsigned int i = ready_heap_len++;
+
+	while (i > 0)
+	{
+		unsigned int parent = (i - 1) / 2;
+
+		if (!runs_before(se, ready_heap[parent]))
+		{
+			break;
+		}
+
+		ready_heap[i] = ready_heap[parent];
+		i = parent;
+	}
+
+	ready_heap[i] = se;
+}
+
+static uthread_t fair_pick_next(void)
+{
+	if (ready_heap_len == 0)
+	{
+		return NULL;
+	}
+
+	struct sched_entity *top = ready_heap[0];
+	struct sched_entity *last = ready_heap[--ready_heap_len];
+	unsigned int i = 0;
+
+	// sift the last item down from the root
+	while (2 * i + 1 < ready_heap_len)
+	{
+		unsigned int child = 2 * i + 1;
+
+		if (child + 1 < ready_heap_len &&
+			runs_before(ready_heap[child + 1], ready_heap[child]))
+		{
+			child++;
+		}
+
+		if (!runs_before(ready_heap[child], last))
+		{
+			break;
+		}
+
+		ready_heap[i] = ready_heap[child];
+		i = child;
+	}
+
+	if (ready_heap_len > 0)
+	{
+		ready_heap[i] = last;
+	}
+
+	if (top->vruntime > min_vruntime)
+	{
+		min_vruntime = top->vruntime;
+	}
+
+	// not since the last charge, which may be followed by an exit or idling
+	run_start = now_ns();
+
+	return sched_entity_thread(top);
+}
+
+static void fair_on_block(uthread_t thread)
+{
+	charge(uthread_sched_entity(thread));
+}
+
+static void fair_on_exit(uthread_t thread)
+{
+	(void)thread;
+
+	live_threads--;
+}
+
+const uthread_sched_ops_t sched_fair_ops = {
+	.init = fair_init,
+	.fini = fair_fini,
+	.on_create = fair_on_create,
+	.enqueue_ready = fair_enqueue_ready,
+	.pick_next = fair_pick_next,
+	.on_block = fair_on_block,
+	.on_exit = fair_on_exit,
+};
@@ -0,0 +1,71 @@
+#include <stddef.h>
+
+#include "iqueue.h"
+#include "private.h"
+#include "uthread.h"
+
+/*
+ * FIFO and LIFO policies, which share a single ready queue
+ */
+static struct iqueue ready_queue;
+
+static int fifo_init(void)
+{
+	iqueue_init(&ready_queue);
+	return 0;
+}
+
+static void fifo_enqueue_ready(uthread_t thread)
+{
+	iqueue_enqueue(&ready_queue, &uthread_sched_entity(thread)->node);
+}
+
+void fifo_enqueue_ready_all(struct iqueue *threads)
+{
+	iqueue_splice(&ready_queue, threads);
+}
+
+void fifo_enqueue_ready_next(uthread_t thread)
+{
+	iqueue_push(&ready_queue, &uthread_sched_entity(thread)->node);
+}
+
+static void lifo_enqueue_ready(uthread_t thread)
+{
+	struct sched_entity *se = uthread_sched_entity(thread);
+
+	// The running thread still goes to the back, otherwise yielding would just
+	// keep running it
+	if (thread == uthread_current())
+	{
+		iqueue_enqueue(&ready_queue, &se->node);
+	}
+	else
+	{
+		iqueue_push(&ready_queue, &se->node);
+	}
+}
+
+static uthread_t fifo_pick_next(void)
+{
+	struct iqueue_node *node = iqueue_dequeue(&ready_queue);
+
+	if (node == NULL)
+	{
+		return NULL;
+	}
+
+	return sched_entity_thread(iqueue_entry(node, struct sched_entity, node));
+}
+
+const uthread_sched_ops_t sched_fifo_ops = {
+	.init = fifo_init,
+	.enqueue_ready = fifo_enqueue_ready,
+	.pick_next = fifo_pick_next,
+};
+
+const uthread_sched_ops_t sched_lifo_ops = {
+	.init = fifo_init,
+	.enqueue_ready = lifo_enqueue_ready,
+	.pick_next = fifo_pick_next,
+};
@@ -0,0 +1,210 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "iqueue.h"
+#include "private.h"
+#include "uthread.h"
+
+/* Period of the MLFQ priority boost, which prevents starvation (in ms) */
+#define MLFQ_BOOST_PERIOD_MS 100
+
+/*
+ * Multilevel feedback queue policy
+ *
+ * One ready queue per priority level, and a bitmap of the non-empty ones. The
+ * level of a thread moves between its priority (the highest it can get) and
+ * the lowest level.
+ *
+ * A thread is demoted once it used a whole quantum of CPU time at its level,
+ * over as many runs as it takes. The preemption tick isn't synchronized with
+ * switches, so demoting on ticks would punish a thread picked right before one
+ * and never catch a thread that yields right before each. For the same reason,
+ * a tick lets a thread that ran for less than half a quantum keep running.
+ */
+static struct iqueue ready_queues[UTHREAD_PRIO_LEVELS];
+static unsigned int ready_levels;
+
+// Priority boost, periodically moving every thread back to its priority level
+// so that demoted threads don't starve
+static unsigned int boost_epoch;
+static struct timespec last_boost;
+
+// When the running thread got the CPU, and when it was last charged
+static uint64_t slice_start;
+static uint64_t run_start;
+
+// CPU time of the worker, which only ever runs one thread at a time (MLFQ
+// scheduling is single-worker)
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Move a thread to another level, where it starts over with a new quantum
+static void set_level(struct sched_entity *se, unsigned int level)
+{
+	se->level = level;
+	se->runtime = 0;
+}
+
+// Charge the running thread for the CPU time it used since it was scheduled,
+// and demote it once that adds up to a whole quantum
+static void charge(struct sched_entity *se)
+{
+	uint64_t now = now_ns();
+
+	se->runtime += now - run_start;
+	run_start = now;
+
+	if (se->runtime >= preempt_quantum_us() * 1000ULL &&
+		se->level < UTHREAD_PRIO_LEVELS - 1)
+	{
+		set_level(se, se->level + 1);
+	}
+}
+
+static int mlfq_init(void)
+{
+	for (int level = 0; level < UTHREAD_PRIO_LEVELS; level++)
+	{
+		iqueue_init(&ready_queues[level]);
+	}
+	ready_levels = 0;
+	boost_epoch = 0;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &last_boost);
+	run_start = slice_start = now_ns();
+
+	return 0;
+}
+
+static int mlfq_on_create(uthread_t thread, const uthread_attr_t *attr)
+{
+	struct sched_entity *se = uthread_sched_entity(thread);
+
+	set_level(se, attr->priority);
+	se->boost_epoch = boost_epoch;
+
+	return 0;
+}
+
+static void mlfq_enqueue_ready(uthread_t thread)
+{
+	struct sched_entity *se = uthread_sched_entity(thread);
+
+	// a thread that yields or gets preempted
+	if (thread == uthread_current())
+	{
+		charge(se);
+	}
+
+	// threads that were blocked or running during a boost get it now
+	if (se->boost_epoch != boost_epoch)
+	{
+		set_level(se, se->priority);
+		se->boost_epoch = boost_epoch;
+	}
+
+	iqueue_enqueue(&ready_queues[se->level], &se->node);
+	ready_levels |= 1U << se->level;
+}
+
+static void mlfq_boost(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+	if ((now.tv_sec - last_boost.tv_sec) * 1000 +
+			(now.tv_nsec - last_boost.tv_nsec) / 1000000 <
+		MLFQ_BOOST_PERIOD_MS)
+	{
+		return;
+	}
+
+	last_boost = now;
+	boost_epoch++;
+
+	// Move ready threads back to their priority level, which is never lower
+	ready_levels = 0;
+	for (unsigned int level = 0; level < UTHREAD_PRIO_LEVELS; level++)
+	{
+		unsigned int len = iqueue_length(&ready_queues[level]);
+
+		for (unsigned int i = 0; i < len; i++)
+		{
+			struct iqueue_node *node = iqueue_dequeue(&ready_queues[level]);
+			struct sched_entity *se =
+				iqueue_entry(node, struct sched_entity, node);
+
+			mlfq_enqueue_ready(sched_entity_thread(se));
+		}
+	}
+}
+
+static uthread_t mlfq_pick_next(void)
+{
+	mlfq_boost();
+
+	if (ready_levels == 0)
+	{
+		return NULL;
+	}
+
+	// highest priority non-empty level
+	unsigned int level = __builtin_ctz(ready_levels);
+	struct iqueue_node *node = iqueue_dequeue(&ready_queues[level]);
+
+	if (iqueue_length(&ready_queues[level]) == 0)
+	{
+		ready_levels &= ~(1U << level);
+	}
+
+	run_start = slice_start = now_ns();
+
+	return sched_entity_thread(iqueue_entry(node, struct sched_entity, node));
+}
+
+static void mlfq_on_block(uthread_t thread)
+{
+	struct sched_entity *se = uthread_sched_entity(thread);
+	unsigned int level = se->level;
+
+	charge(se);
+
+	// Threads giving up the CPU to wait are promoted one level, unless that
+	// used up their quantum
+	if (se->level == level && level > (unsigned int)se->priority)
+	{
+		set_level(se, level - 1);
+	}
+}
+
+static bool mlfq_on_tick(uthread_t thread)
+{
+	struct sched_entity *se = uthread_sched_entity(thread);
+	unsigned int level = se->level;
+
+	charge(se);
+
+	return se->level != level ||
+		   run_start - slice_start >= preempt_quantum_us() * 1000ULL / 2;
+}
+
+static void mlfq_on_priority(uthread_t thread, int priority)
+{
+	set_level(uthread_sched_entity(thread), priority);
+}
+
+const uthread_sched_ops_t sched_mlfq_ops = {
+	.init = mlfq_init,
+	.on_create = mlfq_on_create,
+	.enqueue_ready = mlfq_enqueue_ready,
+	.pick_next = mlfq_pick_next,
+	.on_block = mlfq_on_block,
+	.on_tick = mlfq_on_tick,
+	.on_priority = mlfq_on_priority,
+};
@@ -0,0 +1,298 @@
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "chan.h"
+#include "private.h"
+#include "select.h"
+#include "sem.h"
+#include "spinlock.h"
+
+/* Number of cases whose waiters fit on the stack, more are allocated */
+#define SELECT_STACK_CASES 8
+
+/*
+ * A select locks the semaphores and channels of all its cases, in address
+ * order so that two selects can't deadlock. With every lock held, it first
+ * looks for a case that can be done right away: nobody can complete a case for
+ * it meanwhile, so this one wins. Otherwise, it registers a waiter in the
+ * queue of every case and blocks: the first one to claim it with
+ * select_claim() completes its case, and the other registrations are stale.
+ * Once woken up, the thread removes them from their queues in O(1) each.
+ */
+union select_waiter
+{
+	struct sem_waiter sem;
+	struct chan_waiter chan;
+};
+
+bool select_claim(struct select_wait *sel, unsigned int index)
+{
+	int none = -1;
+
+	return __atomic_compare_exchange_n(&sel->winner, &none, (int)index, false,
+									   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+bool select_decided(struct select_wait *sel)
+{
+	return __atomic_load_n(&sel->winner, __ATOMIC_ACQUIRE) != -1;
+}
+
+void select_wake(struct select_wait *sel, bool next)
+{
+	// the thread is switched out once we hold the lock
+	spin_lock(&sel->lock);
+	struct uthread_tcb *thread = sel->thread;
+	spin_unlock(&sel->lock);
+
+	if (next)
+	{
+		uthread_unblock_next(thread);
+	}
+	else
+	{
+		uthread_unblock(thread);
+	}
+}
+
+static bool case_valid(const uthread_select_case_t *c)
+{
+	switch (c->op)
+	{
+	case UTHREAD_SELECT_DOWN:
+		return c->sem != NULL;
+	case UTHREAD_SELECT_SEND:
+	case UTHREAD_SELECT_RECV:
+		return c->chan != NULL && c->msg != NULL;
+	}
+
+	return false;
+}
+
+static spinlock_t *case_lock(const uthread_select_case_t *c)
+{
+	return c->op == UTHREAD_SELECT_DOWN ? sem_select_lock(c->sem)
+										: chan_select_lock(c->chan);
+}
+
+// Sort the locks of the cases by address, without duplicates
+static size_t sort_locks(const uthread_select_case_t *cases, size_t ncases,
+						 spinlock_t **locks)
+{
+	size_t nlocks = 0;
+
+	for (size_t i = 0; i < ncases; i++)
+	{
+		spinlock_t *lock = case_lock(&cases[i]);
+		size_t j = nlocks;
+
+		while (j > 0 && locks[j - 1] > lock)
+		{
+			j--;
+		}
+
+		if (j > 0 && locks[j - 1] == lock)
+		{
+			continue;
+		}
+
+		for (size_t k = nlocks; k > j; k--)
+		{
+			locks[k] = locks[k - 1];
+		}
+		locks[j] = lock;
+		nlocks++;
+	}
+
+	return nlocks;
+}
+
+static void lock_all(spinlock_t **locks, size_t nlocks)
+{
+	for (size_t i = 0; i < nlocks; i++)
+	{
+		spin_lock(locks[i]);
+	}
+}
+
+static void unlock_all(spinlock_t **locks, size_t nlocks)
+{
+	for (size_t i = nlocks; i > 0; i--)
+	{
+		spin_unlock(locks[i - 1]);
+	}
+}
+
+/*
+ * select_now - Look for a case that can be done right away, with the locks held
+ *
+ * Return: Index of the case done, or -1
+ */
+static int select_now(uthread_select_case_t *cases, size_t ncases,
+					  struct chan_waiter **peer)
+{
+	*peer = NULL;
+
+	for (size_t i = 0; i < ncases; i++)
+	{
+		uthread_select_case_t *c = &cases[i];
+
+		if (c->op == UTHREAD_SELECT_DOWN)
+		{
+			if (sem_select_try(c->sem))
+			{
+				c->result = 0;
+				return i;
+			}
+		}
+		else if (chan_select_try(c->chan, c->op == UTHREAD_SELECT_SEND, c->msg,
+								 &c->result, peer))
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+// Register a waiter for every case, with the locks held
+static void select_register(uthread_select_case_t *cases, size_t ncases,
+							union select_waiter *waiters,
+							struct select_wait *sel)
+{
+	for (size_t i = 0; i < ncases; i++)
+	{
+		uthread_select_case_t *c = &cases[i];
+
+		if (c->op == UTHREAD_SELECT_DOWN)
+		{
+			struct sem_waiter *w = &waiters[i].sem;
+
+			w->waiter.thread = sel->thread;
+			w->select = sel;
+			w->index = i;
+			sem_select_wait(c->sem, w);
+		}
+		else
+		{
+			struct chan_waiter *w = &waiters[i].chan;
+
+			w->waiter.thread = sel->thread;
+			w->msg = c->msg;
+			w->status = 0;
+			w->select = sel;
+			w->index = i;
+			chan_select_wait(c->chan, c->op == UTHREAD_SELECT_SEND, w);
+		}
+	}
+}
+
+// Remove the registrations of the cases that didn't win, with the locks held
+static void select_cancel(uthread_select_case_t *cases, size_t ncases,
+						  union select_waiter *waiters, int winner)
+{
+	for (size_t i = 0; i < ncases; i++)
+	{
+		uthread_select_case_t *c = &cases[i];
+
+		if ((int)i == winner)
+		{
+			c->result =
+				c->op == UTHREAD_SELECT_DOWN ? 0 : waiters[i].chan.status;
+		}
+		else if (c->op == UTHREAD_SELECT_DOWN)
+		{
+			sem_select_cancel(c->sem, &waiters[i].sem);
+		}
+		else
+		{
+			chan_select_cancel(c->chan, c->op == UTHREAD_SELECT_SEND,
+							   &waiters[i].chan);
+		}
+	}
+}
+
+int uthread_select(uthread_select_case_t *cases, size_t ncases)
+{
+	union select_waiter stack_waiters[SELECT_STACK_CASES];
+	spinlock_t *stack_locks[SELECT_STACK_CASES];
+	union select_waiter *waiters = stack_waiters;
+	spinlock_t **locks = stack_locks;
+
+	if (cases == NULL || ncases == 0 || ncases > INT_MAX)
+	{
+		return -1;
+	}
+
+	for (size_t i = 0; i < ncases; i++)
+	{
+		if (!case_valid(&cases[i]))
+		{
+			return -1;
+		}
+	}
+
+	if (ncases > SELECT_STACK_CASES)
+	{
+		waiters = malloc(ncases * sizeof(*waiters));
+		locks = malloc(ncases * sizeof(*locks));
+
+		if (waiters == NULL || locks == NULL)
+		{
+			free(waiters);
+			free(locks);
+			return -1;
+		}
+	}
+
+	size_t nlocks = sort_locks(cases, ncases, locks);
+	struct chan_waiter *peer;
+
+	preempt_disable();
+	lock_all(locks, nlocks);
+
+	int winner = select_now(cases, ncases, &peer);
+
+	if (winner != -1)
+	{
+		unlock_all(locks, nlocks);
+
+		if (peer != NULL)
+		{
+			chan_wake(peer, cases[winner].op == UTHREAD_SELECT_SEND);
+		}
+	}
+	else
+	{
+		struct select_wait sel;
+
+		spin_init(&sel.lock);
+		sel.thread = uthread_current();
+		sel.winner = -1;
+
+		select_register(cases, ncases, waiters, &sel);
+
+		// wakers need our lock, which is released once we're switched out
+		spin_lock(&sel.lock);
+		unlock_all(locks, nlocks);
+		uthread_block(&sel.lock);
+
+		winner = __atomic_load_n(&sel.winner, __ATOMIC_ACQUIRE);
+
+		lock_all(locks, nlocks);
+		select_cancel(cases, ncases, waiters, winner);
+		unlock_all(locks, nlocks);
+	}
+
+	preempt_enable();
+
+	if (waiters != stack_waiters)
+	{
+		free(waiters);
+		free(locks);
+	}
+
+	return winner;
+}
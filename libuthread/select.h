@@ -0,0 +1,55 @@
+#ifndef _UTHREAD_SELECT_H
+#define _UTHREAD_SELECT_H
+
+#include <sys/types.h>
+
+#include "chan.h"
+#include "sem.h"
+
+/*
+ * uthread_select_op_t - Operation of a select case
+ * @UTHREAD_SELECT_DOWN: sem_down() on @sem
+ * @UTHREAD_SELECT_SEND: uthread_chan_send() of @msg to @chan
+ * @UTHREAD_SELECT_RECV: uthread_chan_recv() from @chan into @msg
+ */
+typedef enum
+{
+	UTHREAD_SELECT_DOWN,
+	UTHREAD_SELECT_SEND,
+	UTHREAD_SELECT_RECV
+} uthread_select_op_t;
+
+/*
+ * uthread_select_case_t - Case of a select
+ * @op: Operation to do
+ * @sem: Semaphore of a UTHREAD_SELECT_DOWN case
+ * @chan: Channel of a UTHREAD_SELECT_SEND or UTHREAD_SELECT_RECV case
+ * @msg: Message to send, or where to copy the message received
+ * @result: Set to what the operation would have returned once the case is
+ *	the one done, i.e. 0 or UTHREAD_CHAN_CLOSED
+ */
+typedef struct uthread_select_case
+{
+	uthread_select_op_t op;
+	sem_t sem;
+	uthread_chan_t chan;
+	void *msg;
+	int result;
+} uthread_select_case_t;
+
+/*
+ * uthread_select - Do the first of several operations that can be done
+ * @cases: Operations to choose from
+ * @ncases: Number of cases
+ *
+ * If some operations can be done right away, the first one in @cases is done.
+ * Otherwise, the caller thread is blocked until one of them can be done, and
+ * only this one is done. Sending to or receiving from a closed channel counts
+ * as done, with a @result of UTHREAD_CHAN_CLOSED.
+ *
+ * Return: -1 if @cases is NULL, @ncases is 0, or a case has a NULL semaphore,
+ * channel or message. Otherwise, the index of the case that was done.
+ */
+int uthread_select(uthread_select_case_t *cases, size_t ncases);
+
+#endif /* _UTHREAD_SELECT_H */
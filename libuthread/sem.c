@@ -1,53 +1,206 @@
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 
-#include "queue.h"
+#include "iqueue.h"
 #include "sem.h"
 #include "private.h"
+#include "spinlock.h"
 
 struct semaphore
 {
-	queue_t wait_queue;
-	int count;
+	spinlock_t lock;
+	struct iqueue wait_queue;
+	size_t count;
+	unsigned int pending; /* Granted waiters left to their expired timer */
 };
 
 typedef struct semaphore semaphore;
 
-sem_t sem_create(size_t count)
+/*
+ * Hand resources over to waiters, oldest first, with the lock held
+ *
+ * Waiters to wake up are moved to @woken.
+ */
+static void sem_grant(semaphore *sem, struct iqueue *woken)
 {
-	sem_t new_sem = malloc(sizeof(semaphore));
+	struct iqueue_node *node = sem->wait_queue.head.next;
 
-	if (new_sem == NULL)
+	while (node != &sem->wait_queue.head)
 	{
-		return NULL;
+		struct iqueue_node *next = node->next;
+		struct sem_waiter *w =
+			iqueue_entry(node, struct sem_waiter, waiter.node);
+
+		if (w->select != NULL && select_decided(w->select))
+		{
+			node = next;
+			continue;
+		}
+
+		if (sem->count < w->needed)
+		{
+			break;
+		}
+
+		// a select that another case won meanwhile doesn't take anything
+		if (w->select != NULL && !select_claim(w->select, w->index))
+		{
+			node = next;
+			continue;
+		}
+
+		iqueue_delete(&sem->wait_queue, node);
+		sem->count -= w->needed;
+
+		// an expired timer wakes the thread up itself, and still needs the
+		// semaphore until then
+		if (!w->timed || timer_cancel(&w->timer))
+		{
+			iqueue_enqueue(woken, node);
+		}
+		else
+		{
+			sem->pending++;
+		}
+
+		node = next;
+	}
+}
+
+// Wake up the waiters moved by sem_grant(), without the lock held
+static void sem_wake(struct iqueue *woken)
+{
+	struct iqueue_node *node;
+
+	while ((node = iqueue_dequeue(woken)) != NULL)
+	{
+		struct sem_waiter *w =
+			iqueue_entry(node, struct sem_waiter, waiter.node);
+
+		// the waiter is gone as soon as its thread runs
+		if (w->select != NULL)
+		{
+			select_wake(w->select, false);
+		}
+		else if (w->timed)
+		{
+			io_waiter_done(w->waiter.thread);
+		}
+		else
+		{
+			uthread_unblock(w->waiter.thread);
+		}
+	}
+}
+
+/*
+ * Whether a thread waits for resources, with the lock held
+ *
+ * Registrations of selects that another case already won stay queued until
+ * their select removes them, and don't count.
+ */
+static bool sem_waiting(semaphore *sem)
+{
+	struct iqueue_node *node;
+
+	for (node = sem->wait_queue.head.next; node != &sem->wait_queue.head;
+		 node = node->next)
+	{
+		struct sem_waiter *w =
+			iqueue_entry(node, struct sem_waiter, waiter.node);
+
+		if (w->select == NULL || !select_decided(w->select))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void sem_timeout(struct uthread_timer *timer)
+{
+	struct sem_waiter *w = iqueue_entry(timer, struct sem_waiter, timer);
+	semaphore *sem = w->sem;
+	struct iqueue woken;
+
+	iqueue_init(&woken);
+
+	// the thread is switched out once we hold the lock
+	spin_lock(&sem->lock);
+
+	if (iqueue_linked(&w->waiter.node))
+	{
+		iqueue_delete(&sem->wait_queue, &w->waiter.node);
+		w->timed_out = true;
+
+		// the waiters behind may need less
+		sem_grant(sem, &woken);
+	}
+	else
+	{
+		sem->pending--;
 	}
 
-	new_sem->wait_queue = queue_create();
-	if (new_sem->wait_queue == NULL)
+	spin_unlock(&sem->lock);
+
+	io_waiter_done(w->waiter.thread);
+	sem_wake(&woken);
+}
+
+sem_t sem_create(size_t count)
+{
+	sem_t new_sem = malloc(sizeof(semaphore));
+
+	if (new_sem == NULL)
 	{
-		free(new_sem);
 		return NULL;
 	}
 
+	spin_init(&new_sem->lock);
+	iqueue_init(&new_sem->wait_queue);
 	new_sem->count = count;
+	new_sem->pending = 0;
 
 	return new_sem;
 }
 
 int sem_destroy(sem_t sem)
 {
-	if (sem == NULL || queue_length(sem->wait_queue) > 0)
+	if (sem == NULL)
+	{
+		return -1;
+	}
+
+	// wait for a sem_up() from another worker to be done with the semaphore,
+	// for selects to remove their registrations, and for expired timers of
+	// granted waiters to be done with it
+	preempt_disable();
+	spin_lock(&sem->lock);
+	unsigned int waiting = iqueue_length(&sem->wait_queue) + sem->pending;
+	spin_unlock(&sem->lock);
+	preempt_enable();
+
+	if (waiting > 0)
 	{
 		return -1;
 	}
 
-	queue_destroy(sem->wait_queue);
 	free(sem);
 
 	return 0;
 }
 
-int sem_down(sem_t sem)
+/*
+ * sem_wait - Take resources from a semaphore
+ * @sem: Semaphore to take from
+ * @n: Number of resources
+ * @timed: Whether to give up after @ns nanoseconds
+ * @ns: Maximum time to wait
+ */
+static int sem_wait(sem_t sem, size_t n, bool timed, uint64_t ns)
 {
 	if (sem == NULL)
 	{
@@ -55,46 +208,142 @@ int sem_down(sem_t sem)
 	}
 
 	preempt_disable();
+	spin_lock(&sem->lock);
 
-	if (sem->count == 0)
+	if (sem->count >= n && !sem_waiting(sem))
 	{
-		queue_enqueue(sem->wait_queue, uthread_current());
-		uthread_block();
+		sem->count -= n;
+		spin_unlock(&sem->lock);
+		preempt_enable();
+		return 0;
 	}
-	else
+
+	if (timed && ns == 0)
 	{
-		sem->count--;
+		spin_unlock(&sem->lock);
+		preempt_enable();
+		return SEM_TIMEDOUT;
 	}
 
+	struct sem_waiter w;
+
+	w.waiter.thread = uthread_current();
+	w.sem = sem;
+	w.needed = n;
+	w.timed = timed;
+	w.timed_out = false;
+	w.select = NULL;
+
+	if (timed)
+	{
+		uint64_t now = timer_now();
+
+		w.timer.deadline = ns < UINT64_MAX - now ? now + ns : UINT64_MAX;
+		w.timer.expire = sem_timeout;
+
+		if (timer_add(&w.timer) == -1)
+		{
+			spin_unlock(&sem->lock);
+			preempt_enable();
+			return -1;
+		}
+
+		// counted as waiting for I/O, so that the timer keeps being polled
+		io_waiter_add();
+	}
+
+	// the lock is released once we're switched out
+	iqueue_enqueue(&sem->wait_queue, &w.waiter.node);
+	uthread_block(&sem->lock);
+
 	preempt_enable();
 
-	return 0;
+	return w.timed_out ? SEM_TIMEDOUT : 0;
+}
+
+int sem_down(sem_t sem)
+{
+	return sem_wait(sem, 1, false, 0);
+}
+
+int sem_down_n(sem_t sem, size_t n)
+{
+	return sem_wait(sem, n, false, 0);
+}
+
+int sem_down_timeout(sem_t sem, uint64_t ns)
+{
+	return sem_wait(sem, 1, true, ns);
+}
+
+int sem_trydown(sem_t sem)
+{
+	return sem_wait(sem, 1, true, 0);
 }
 
 int sem_up(sem_t sem)
 {
+	return sem_up_n(sem, 1);
+}
+
+int sem_up_n(sem_t sem, size_t n)
+{
+	struct iqueue woken;
+
 	if (sem == NULL)
 	{
 		return -1;
 	}
 
+	iqueue_init(&woken);
+
 	preempt_disable();
+	spin_lock(&sem->lock);
 
-	sem->count++;
+	// resources go to the waiters first, so that nobody steals them before
+	// they run
+	sem->count += n;
+	sem_grant(sem, &woken);
 
-	// unblock next in queue
-	// make sure to decrement to prevent stealing before the scheduler runs
-	struct uthread_tcb *next_thread = NULL;
+	spin_unlock(&sem->lock);
 
-	queue_dequeue(sem->wait_queue, (void **)&next_thread);
+	sem_wake(&woken);
 
-	if (next_thread != NULL && sem->count > 0)
+	preempt_enable();
+
+	return 0;
+}
+
+spinlock_t *sem_select_lock(sem_t sem)
+{
+	return &sem->lock;
+}
+
+bool sem_select_try(sem_t sem)
+{
+	if (sem->count == 0 || sem_waiting(sem))
 	{
-		sem->count--;
-		uthread_unblock(next_thread);
+		return false;
 	}
 
-	preempt_enable();
+	sem->count--;
 
-	return 0;
+	return true;
+}
+
+void sem_select_wait(sem_t sem, struct sem_waiter *w)
+{
+	w->sem = sem;
+	w->needed = 1;
+	w->timed = false;
+	w->timed_out = false;
+	iqueue_enqueue(&sem->wait_queue, &w->waiter.node);
+}
+
+void sem_select_cancel(sem_t sem, struct sem_waiter *w)
+{
+	if (iqueue_linked(&w->waiter.node))
+	{
+		iqueue_delete(&sem->wait_queue, &w->waiter.node);
+	}
 }
@@ -15,6 +15,9 @@
  */
 typedef struct semaphore *sem_t;
 
+/* Returned when a semaphore couldn't be taken in time */
+#define SEM_TIMEDOUT (-2)
+
 /*
  * sem_create - Create semaphore
  * @count: Semaphore count
@@ -33,7 +36,8 @@ sem_t sem_create(size_t count);
  * Deallocate semaphore @sem.
  *
  * Return: -1 if @sem is NULL or if other threads are still being blocked on
- * @sem. 0 is @sem was successfully destroyed.
+ * @sem, including in a uthread_select() that hasn't returned yet. 0 is @sem
+ * was successfully destroyed.
  */
 int sem_destroy(sem_t sem);
 
@@ -50,6 +54,44 @@ int sem_destroy(sem_t sem);
  */
 int sem_down(sem_t sem);
 
+/*
+ * sem_down_n - Take several resources from a semaphore at once
+ * @sem: Semaphore to take
+ * @n: Number of resources to take
+ *
+ * Take @n resources from semaphore @sem, all at once: the caller thread is
+ * blocked until @n resources are available. Waiting threads are served in
+ * order, so a thread waiting for many resources holds back the ones behind it.
+ *
+ * Return: -1 if @sem is NULL. 0 if the resources were successfully taken.
+ */
+int sem_down_n(sem_t sem, size_t n);
+
+/*
+ * sem_down_timeout - Take a semaphore, waiting for a limited time
+ * @sem: Semaphore to take
+ * @ns: Maximum time to wait (in nanoseconds)
+ *
+ * Same as sem_down(), but give up if @sem is still unavailable after @ns
+ * nanoseconds. A thread that gives up leaves the waiting list in constant time.
+ *
+ * Return: -1 if @sem is NULL or in case of failure (memory allocation),
+ * SEM_TIMEDOUT if @sem couldn't be taken in time. 0 if semaphore was
+ * successfully taken.
+ */
+int sem_down_timeout(sem_t sem, uint64_t ns);
+
+/*
+ * sem_trydown - Take a semaphore without waiting
+ * @sem: Semaphore to take
+ *
+ * Same as sem_down_timeout() with a timeout of 0: the caller is never blocked.
+ *
+ * Return: -1 if @sem is NULL, SEM_TIMEDOUT if @sem is unavailable. 0 if
+ * semaphore was successfully taken.
+ */
+int sem_trydown(sem_t sem);
+
 /*
  * sem_up - Release a semaphore
  * @sem: Semaphore to release
@@ -64,4 +106,16 @@ int sem_down(sem_t sem);
  */
 int sem_up(sem_t sem);
 
+/*
+ * sem_up_n - Release several resources to a semaphore at once
+ * @sem: Semaphore to release
+ * @n: Number of resources to release
+ *
+ * Same as calling sem_up() @n times, but every thread that can be unblocked is
+ * in a single critical section.
+ *
+ * Return: -1 if @sem is NULL. 0 if the resources were successfully released.
+ */
+int sem_up_n(sem_t sem, size_t n);
+
 #endif /* _SEMAPHORE_H */
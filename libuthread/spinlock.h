@@ -0,0 +1,68 @@
+#ifndef _SPINLOCK_H
+#define _SPINLOCK_H
+
+#include <sched.h>
+
+/*
+ * spinlock_t - Spinlock type
+ *
+ * Protects data shared between workers (see uthread_run_attr_t). Spinlocks
+ * must only be held with preemption disabled, and for short sections: a worker
+ * waiting for one keeps spinning on its CPU.
+ */
+typedef struct spinlock
+{
+	int locked;
+} spinlock_t;
+
+/* Number of times a waiter spins before giving up its CPU */
+#define SPINLOCK_SPINS 128
+
+/* Static initializer of an unlocked spinlock */
+#define SPINLOCK_INIT {0}
+
+/*
+ * spin_init - Initialize an unlocked spinlock
+ * @lock: Spinlock to initialize
+ */
+static inline void spin_init(spinlock_t *lock)
+{
+	lock->locked = 0;
+}
+
+/*
+ * spin_lock - Acquire a spinlock
+ * @lock: Spinlock to acquire
+ */
+static inline void spin_lock(spinlock_t *lock)
+{
+	while (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE))
+	{
+		// wait for the lock to look free before trying again, so that the
+		// cache line isn't bounced around between waiters
+		for (unsigned int spins = 0;
+			 __atomic_load_n(&lock->locked, __ATOMIC_RELAXED); spins++)
+		{
+			// the holder may have been descheduled, let it run
+			if (spins >= SPINLOCK_SPINS)
+			{
+				sched_yield();
+				spins = 0;
+			}
+#if defined(__x86_64__) || defined(__i386__)
+			__builtin_ia32_pause();
+#endif
+		}
+	}
+}
+
+/*
+ * spin_unlock - Release a spinlock
+ * @lock: Spinlock to release, held by the caller
+ */
+static inline void spin_unlock(spinlock_t *lock)
+{
+	__atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
+
+#endif /* _SPINLOCK_H */
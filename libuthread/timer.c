@@ -0,0 +1,336 @@
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "private.h"
+#include "spinlock.h"
+#include "uthread.h"
+
+/* Initial capacity of the timer heap */
+#define TIMER_HEAP_DEFAULT_CAPACITY 64
+
+/* Maximum number of timers expired with the heap locked */
+#define TIMER_EXPIRE 64
+
+/*
+ * Pending timers
+ *
+ * Timers are kept in a binary min-heap ordered by deadline, and remember their
+ * index in it so that they can be cancelled in O(log n). A timerfd in the
+ * epoll set is armed for the earliest deadline, so that the poller sleeps
+ * until then when nothing else is left to run.
+ */
+static spinlock_t timer_lock = SPINLOCK_INIT;
+static struct uthread_timer **timer_heap;
+static unsigned int timer_heap_len;
+static unsigned int timer_heap_cap;
+
+// Earliest deadline, or UINT64_MAX, readable without the lock
+static uint64_t timer_next = UINT64_MAX;
+
+// Deadline the timerfd is armed for
+static uint64_t timer_armed;
+static int timer_fd = -1;
+
+/*
+ * A sleeping thread
+ *
+ * The thread keeps the lock held until it is switched out, so that the timer
+ * can't unblock it before its context is saved.
+ */
+struct sleeper
+{
+	struct uthread_timer timer;
+	struct uthread_tcb *thread;
+	spinlock_t lock;
+};
+
+uint64_t timer_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Put @timer at index @i of the heap, and let it know
+static void heap_set(unsigned int i, struct uthread_timer *timer)
+{
+	timer_heap[i] = timer;
+	timer->index = i;
+}
+
+static void sift_up(unsigned int i, struct uthread_timer *timer)
+{
+	while (i > 0)
+	{
+		unsigned int parent = (i - 1) / 2;
+
+		if (timer_heap[parent]->deadline <= timer->deadline)
+		{
+			break;
+		}
+
+		heap_set(i, timer_heap[parent]);
+		i = parent;
+	}
+
+	heap_set(i, timer);
+}
+
+static void sift_down(unsigned int i, struct uthread_timer *timer)
+{
+	while (2 * i + 1 < timer_heap_len)
+	{
+		unsigned int child = 2 * i + 1;
+
+		if (child + 1 < timer_heap_len &&
+			timer_heap[child + 1]->deadline < timer_heap[child]->deadline)
+		{
+			child++;
+		}
+
+		if (timer->deadline <= timer_heap[child]->deadline)
+		{
+			break;
+		}
+
+		heap_set(i, timer_heap[child]);
+		i = child;
+	}
+
+	heap_set(i, timer);
+}
+
+// Remove the timer at index @i, with timer_lock held
+static void heap_remove(unsigned int i)
+{
+	struct uthread_timer *last = timer_heap[--timer_heap_len];
+
+	timer_heap[i]->index = TIMER_NONE;
+
+	if (i == timer_heap_len)
+	{
+		return;
+	}
+
+	// the last timer may belong above or below the hole
+	if (i > 0 && last->deadline < timer_heap[(i - 1) / 2]->deadline)
+	{
+		sift_up(i, last);
+	}
+	else
+	{
+		sift_down(i, last);
+	}
+}
+
+// Arm the timerfd for the earliest deadline, with timer_lock held
+static void timer_rearm(void)
+{
+	uint64_t next = timer_heap_len > 0 ? timer_heap[0]->deadline : UINT64_MAX;
+
+	__atomic_store_n(&timer_next, next, __ATOMIC_RELAXED);
+
+	if (next == UINT64_MAX || next == timer_armed)
+	{
+		return;
+	}
+
+	struct itimerspec its = {
+		.it_value = {
+			.tv_sec = next / 1000000000ULL,
+			.tv_nsec = next % 1000000000ULL,
+		},
+	};
+
+	// a zero deadline would disarm the timerfd instead
+	if (next == 0)
+	{
+		its.it_value.tv_nsec = 1;
+	}
+
+	timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+	timer_armed = next;
+}
+
+int timer_start(void)
+{
+	timer_heap_len = 0;
+	timer_armed = 0;
+	timer_next = UINT64_MAX;
+
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	return timer_fd;
+}
+
+void timer_stop(void)
+{
+	free(timer_heap);
+	timer_heap = NULL;
+	timer_heap_cap = 0;
+
+	if (timer_fd != -1)
+	{
+		close(timer_fd);
+		timer_fd = -1;
+	}
+}
+
+int timer_add(struct uthread_timer *timer)
+{
+	spin_lock(&timer_lock);
+
+	if (timer_heap_len == timer_heap_cap)
+	{
+		unsigned int cap = timer_heap_cap ? timer_heap_cap * 2
+										  : TIMER_HEAP_DEFAULT_CAPACITY;
+		struct uthread_timer **heap =
+			realloc(timer_heap, cap * sizeof(struct uthread_timer *));
+
+		if (heap == NULL)
+		{
+			spin_unlock(&timer_lock);
+			return -1;
+		}
+
+		timer_heap = heap;
+		timer_heap_cap = cap;
+	}
+
+	sift_up(timer_heap_len++, timer);
+
+	if (timer->index == 0)
+	{
+		timer_rearm();
+	}
+
+	spin_unlock(&timer_lock);
+
+	return 0;
+}
+
+bool timer_cancel(struct uthread_timer *timer)
+{
+	bool pending;
+
+	spin_lock(&timer_lock);
+
+	pending = timer->index != TIMER_NONE;
+	if (pending)
+	{
+		heap_remove(timer->index);
+		timer_rearm();
+	}
+
+	spin_unlock(&timer_lock);
+
+	return pending;
+}
+
+void timer_expire(void)
+{
+	struct uthread_timer *expired[TIMER_EXPIRE];
+	unsigned int count;
+
+	if (__atomic_load_n(&timer_next, __ATOMIC_RELAXED) == UINT64_MAX)
+	{
+		return;
+	}
+
+	uint64_t now = timer_now();
+
+	do
+	{
+		count = 0;
+
+		spin_lock(&timer_lock);
+
+		while (timer_heap_len > 0 && timer_heap[0]->deadline <= now &&
+			   count < TIMER_EXPIRE)
+		{
+			expired[count++] = timer_heap[0];
+			heap_remove(0);
+		}
+
+		// the timerfd went off, or will right away
+		if (count > 0)
+		{
+			timer_armed = 0;
+			timer_rearm();
+		}
+
+		spin_unlock(&timer_lock);
+
+		// timers may be gone as soon as they expire
+		for (unsigned int i = 0; i < count; i++)
+		{
+			expired[i]->expire(expired[i]);
+		}
+	} while (count == TIMER_EXPIRE);
+}
+
+void timer_clear(void)
+{
+	uint64_t value;
+
+	if (read(timer_fd, &value, sizeof(value)) == -1)
+	{
+		// already cleared by another worker
+	}
+}
+
+static void sleeper_expire(struct uthread_timer *timer)
+{
+	struct sleeper *s = iqueue_entry(timer, struct sleeper, timer);
+
+	// wait for the thread to be switched out
+	spin_lock(&s->lock);
+	spin_unlock(&s->lock);
+
+	io_waiter_done(s->thread);
+}
+
+int uthread_sleep_until(uint64_t deadline_ns)
+{
+	struct sleeper s;
+
+	if (deadline_ns <= timer_now())
+	{
+		return 0;
+	}
+
+	s.timer.deadline = deadline_ns;
+	s.timer.expire = sleeper_expire;
+
+	preempt_disable();
+
+	s.thread = uthread_current();
+	spin_init(&s.lock);
+	spin_lock(&s.lock);
+
+	if (timer_add(&s.timer) == -1)
+	{
+		spin_unlock(&s.lock);
+		preempt_enable();
+		return -1;
+	}
+
+	io_waiter_add();
+	uthread_block(&s.lock);
+
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_sleep_ns(uint64_t ns)
+{
+	uint64_t now = timer_now();
+
+	return uthread_sleep_until(ns < UINT64_MAX - now ? now + ns : UINT64_MAX);
+}
@@ -0,0 +1,426 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "io.h"
+#include "private.h"
+#include "spinlock.h"
+
+/* Number of submission queue entries */
+#define URING_ENTRIES 1024
+
+/* Number of queued requests that get submitted right away */
+#define URING_BATCH 32
+
+/* Maximum number of completions reaped with the completion queue locked */
+#define URING_REAP 64
+
+/*
+ * A request in flight, on the stack of the thread waiting for it
+ *
+ * The thread keeps the lock held until it is switched out, so that the
+ * completion can't unblock it before its context is saved.
+ */
+struct uring_req
+{
+	struct uthread_tcb *thread;
+	spinlock_t lock;
+	int res;
+};
+
+/*
+ * A request run by a helper kernel thread, when there is no io_uring
+ */
+struct file_op
+{
+	struct pool_job job;
+	uint8_t opcode;
+	int fd;
+	void *buf;
+	size_t count;
+	off_t offset;
+	ssize_t res;
+	int error;
+};
+
+static int ring_fd = -1;
+
+// Submission queue, requests are queued until a batch is submitted
+static spinlock_t sq_lock = SPINLOCK_INIT;
+static void *sq_ring;
+static size_t sq_ring_size;
+static unsigned int *sq_head;
+static unsigned int *sq_tail;
+static unsigned int *sq_flags;
+static unsigned int sq_mask;
+static unsigned int sq_entries;
+static unsigned int sq_unsubmitted;
+static struct io_uring_sqe *sqes;
+
+// Completion queue, reaped by whichever worker polls
+static spinlock_t cq_lock = SPINLOCK_INIT;
+static void *cq_ring;
+static size_t cq_ring_size;
+static unsigned int *cq_head;
+static unsigned int *cq_tail;
+static unsigned int cq_mask;
+static struct io_uring_cqe *cqes;
+
+static int io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(SYS_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned int to_submit, unsigned int flags)
+{
+	return syscall(SYS_io_uring_enter, fd, to_submit, 0, flags, NULL, 0);
+}
+
+int uring_start(bool enable)
+{
+	struct io_uring_params p;
+
+	if (!enable)
+	{
+		return -1;
+	}
+
+	memset(&p, 0, sizeof(p));
+	ring_fd = io_uring_setup(URING_ENTRIES, &p);
+	if (ring_fd == -1)
+	{
+		return -1;
+	}
+
+	// IORING_OP_READ and IORING_OP_WRITE came along with RW_CUR_POS, and
+	// completions must never be dropped since threads wait for them
+	if (!(p.features & IORING_FEAT_RW_CUR_POS) ||
+		!(p.features & IORING_FEAT_NODROP))
+	{
+		uring_stop();
+		return -1;
+	}
+
+	sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (cq_ring_size > sq_ring_size)
+		{
+			sq_ring_size = cq_ring_size;
+		}
+		cq_ring_size = 0;
+	}
+
+	sq_ring = mmap(NULL, sq_ring_size, PROT_READ | PROT_WRITE,
+				   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+	if (sq_ring == MAP_FAILED)
+	{
+		sq_ring = NULL;
+		uring_stop();
+		return -1;
+	}
+
+	cq_ring = sq_ring;
+	if (cq_ring_size > 0)
+	{
+		cq_ring = mmap(NULL, cq_ring_size, PROT_READ | PROT_WRITE,
+					   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+		if (cq_ring == MAP_FAILED)
+		{
+			cq_ring = NULL;
+			uring_stop();
+			return -1;
+		}
+	}
+
+	sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+				PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+				IORING_OFF_SQES);
+	if (sqes == MAP_FAILED)
+	{
+		sqes = NULL;
+		uring_stop();
+		return -1;
+	}
+
+	sq_head = (unsigned int *)((char *)sq_ring + p.sq_off.head);
+	sq_tail = (unsigned int *)((char *)sq_ring + p.sq_off.tail);
+	sq_flags = (unsigned int *)((char *)sq_ring + p.sq_off.flags);
+	sq_mask = *(unsigned int *)((char *)sq_ring + p.sq_off.ring_mask);
+	sq_entries = p.sq_entries;
+	sq_unsubmitted = 0;
+
+	// entry i of the submission queue always uses SQE i
+	unsigned int *array = (unsigned int *)((char *)sq_ring + p.sq_off.array);
+
+	for (unsigned int i = 0; i < sq_entries; i++)
+	{
+		array[i] = i;
+	}
+
+	cq_head = (unsigned int *)((char *)cq_ring + p.cq_off.head);
+	cq_tail = (unsigned int *)((char *)cq_ring + p.cq_off.tail);
+	cq_mask = *(unsigned int *)((char *)cq_ring + p.cq_off.ring_mask);
+	cqes = (struct io_uring_cqe *)((char *)cq_ring + p.cq_off.cqes);
+
+	return ring_fd;
+}
+
+void uring_stop(void)
+{
+	if (sqes != NULL)
+	{
+		munmap(sqes, sq_entries * sizeof(struct io_uring_sqe));
+		sqes = NULL;
+	}
+
+	if (cq_ring != NULL && cq_ring != sq_ring)
+	{
+		munmap(cq_ring, cq_ring_size);
+	}
+	cq_ring = NULL;
+
+	if (sq_ring != NULL)
+	{
+		munmap(sq_ring, sq_ring_size);
+		sq_ring = NULL;
+	}
+
+	if (ring_fd != -1)
+	{
+		close(ring_fd);
+		ring_fd = -1;
+	}
+}
+
+// Submit the queued requests, with sq_lock held
+static void uring_submit(void)
+{
+	if (sq_unsubmitted == 0)
+	{
+		return;
+	}
+
+	// on failure (e.g., EAGAIN), the requests stay queued for the next flush
+	int ret = io_uring_enter(ring_fd, sq_unsubmitted, 0);
+
+	if (ret > 0)
+	{
+		__atomic_sub_fetch(&sq_unsubmitted, ret, __ATOMIC_RELAXED);
+	}
+}
+
+void uring_flush(void)
+{
+	if (ring_fd == -1 || __atomic_load_n(&sq_unsubmitted, __ATOMIC_RELAXED) == 0)
+	{
+		return;
+	}
+
+	spin_lock(&sq_lock);
+	uring_submit();
+	spin_unlock(&sq_lock);
+}
+
+void uring_reap(void)
+{
+	struct uring_req *done[URING_REAP];
+	unsigned int count;
+
+	do
+	{
+		count = 0;
+
+		spin_lock(&cq_lock);
+
+		unsigned int head = *cq_head;
+		unsigned int tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+		while (head != tail && count < URING_REAP)
+		{
+			struct io_uring_cqe *cqe = &cqes[head & cq_mask];
+			struct uring_req *req = (struct uring_req *)(uintptr_t)cqe->user_data;
+
+			req->res = cqe->res;
+			done[count++] = req;
+			head++;
+		}
+
+		__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+		spin_unlock(&cq_lock);
+
+		for (unsigned int i = 0; i < count; i++)
+		{
+			// wait for the thread to be switched out
+			spin_lock(&done[i]->lock);
+			spin_unlock(&done[i]->lock);
+
+			io_waiter_done(done[i]->thread);
+		}
+
+		// completions that didn't fit in the ring are kept aside by the
+		// kernel until asked for, and the ring fd stays readable meanwhile
+		if (count < URING_REAP &&
+			__atomic_load_n(sq_flags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW)
+		{
+			if (io_uring_enter(ring_fd, 0, IORING_ENTER_GETEVENTS) != -1)
+			{
+				count = URING_REAP;
+			}
+		}
+	} while (count == URING_REAP);
+}
+
+/*
+ * uring_op - Run a request through the io_uring
+ *
+ * Return: 0 once the request completed (*@res is set), or -1 if it couldn't be
+ * queued
+ */
+static int uring_op(uint8_t opcode, int fd, void *buf, size_t count,
+					off_t offset, int *res)
+{
+	struct uring_req req;
+
+	preempt_disable();
+	spin_lock(&sq_lock);
+
+	unsigned int tail = *sq_tail;
+
+	if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) == sq_entries)
+	{
+		uring_submit();
+		if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) == sq_entries)
+		{
+			spin_unlock(&sq_lock);
+			preempt_enable();
+			return -1;
+		}
+	}
+
+	struct io_uring_sqe *sqe = &sqes[tail & sq_mask];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t)buf;
+	sqe->len = count;
+	sqe->off = offset;
+	sqe->user_data = (uintptr_t)&req;
+
+	req.thread = uthread_current();
+	spin_init(&req.lock);
+	spin_lock(&req.lock);
+
+	__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	// otherwise, requests are submitted once the worker runs out of threads
+	// or polls
+	if (__atomic_add_fetch(&sq_unsubmitted, 1, __ATOMIC_RELAXED) >=
+		URING_BATCH)
+	{
+		uring_submit();
+	}
+
+	spin_unlock(&sq_lock);
+
+	io_waiter_add();
+	uthread_block(&req.lock);
+
+	preempt_enable();
+
+	*res = req.res;
+	return 0;
+}
+
+static void file_op_run(void *arg)
+{
+	struct file_op *op = (struct file_op *)arg;
+
+	switch (op->opcode)
+	{
+	case IORING_OP_READ:
+		op->res = pread(op->fd, op->buf, op->count, op->offset);
+		break;
+	case IORING_OP_WRITE:
+		op->res = pwrite(op->fd, op->buf, op->count, op->offset);
+		break;
+	default:
+		op->res = fsync(op->fd);
+		break;
+	}
+
+	op->error = errno;
+}
+
+static ssize_t file_op(uint8_t opcode, int fd, void *buf, size_t count,
+					   off_t offset)
+{
+	// a single request reads or writes at most 2GB, like read(2)
+	if (count > INT32_MAX)
+	{
+		count = INT32_MAX;
+	}
+
+	if (ring_fd != -1)
+	{
+		int res;
+
+		if (uring_op(opcode, fd, buf, count, offset, &res) == 0)
+		{
+			if (res < 0)
+			{
+				errno = -res;
+				return -1;
+			}
+			return res;
+		}
+	}
+
+	struct file_op op = {
+		.opcode = opcode,
+		.fd = fd,
+		.buf = buf,
+		.count = count,
+		.offset = offset,
+	};
+
+	op.job.func = file_op_run;
+	op.job.arg = &op;
+
+	// without helpers, the whole worker blocks
+	if (pool_run(&op.job) == -1)
+	{
+		file_op_run(&op);
+	}
+
+	if (op.res == -1)
+	{
+		errno = op.error;
+	}
+	return op.res;
+}
+
+ssize_t uthread_pread(int fd, void *buf, size_t count, off_t offset)
+{
+	return file_op(IORING_OP_READ, fd, buf, count, offset);
+}
+
+ssize_t uthread_pwrite(int fd, const void *buf, size_t count, off_t offset)
+{
+	return file_op(IORING_OP_WRITE, fd, (void *)buf, count, offset);
+}
+
+int uthread_fsync(int fd)
+{
+	return file_op(IORING_OP_FSYNC, fd, NULL, 0, 0);
+}
@@ -1,14 +1,22 @@
 #include <assert.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "deque.h"
+#include "iqueue.h"
 #include "private.h"
+#include "spinlock.h"
 #include "uthread.h"
-#include "queue.h"
 
 enum thread_state
 {
@@ -20,123 +28,829 @@ enum thread_state
 
 typedef enum thread_state thread_state;
 
+/* Cache line size, TCBs are aligned on it so they never share a line */
+#define CACHE_LINE_SIZE 64
+
+/* Number of TCBs carved out of a single slab allocation */
+#define TCB_SLAB_SIZE 64
+
+/* One in that many threads unblocked to run next goes to the back instead */
+#define HANDOFF_MAX 64
+
+/* One in that many picks of a worker looks at the overflow queue first */
+#define OVERFLOW_PICK_EVERY 61
+
+/*
+ * Fields touched on every context switch come first so they share the first
+ * cache line of the TCB
+ */
 struct uthread_tcb
 {
-	void *stack_pointer;
 	thread_state state;
 	uthread_ctx_t uctx;
-};
+	struct sched_entity se;
+
+	void *stack_pointer;
+	size_t stack_size;
+	struct uthread_tcb *next_free;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
 
 typedef struct uthread_tcb uthread_tcb;
 
+/*
+ * TCBs are carved out of slabs and recycled through a free list, so creating
+ * and collecting threads doesn't hit the allocator once the slabs are warm
+ */
+struct tcb_slab
+{
+	struct tcb_slab *next_slab;
+	uthread_tcb tcbs[TCB_SLAB_SIZE];
+};
+
+static struct tcb_slab *tcb_slabs;
+static uthread_tcb *free_tcbs;
+
+static uthread_tcb *alloc_tcb(void)
+{
+	if (free_tcbs == NULL)
+	{
+		struct tcb_slab *slab = aligned_alloc(CACHE_LINE_SIZE,
+											  sizeof(struct tcb_slab));
+		if (slab == NULL)
+		{
+			return NULL;
+		}
+
+		slab->next_slab = tcb_slabs;
+		tcb_slabs = slab;
+
+		for (int i = 0; i < TCB_SLAB_SIZE; i++)
+		{
+			slab->tcbs[i].next_free = free_tcbs;
+			free_tcbs = &slab->tcbs[i];
+		}
+	}
+
+	uthread_tcb *tcb = free_tcbs;
+	free_tcbs = tcb->next_free;
+	return tcb;
+}
+
+static void free_tcb(uthread_tcb *tcb)
+{
+	tcb->next_free = free_tcbs;
+	free_tcbs = tcb;
+}
+
+// Only called once no thread is left, every TCB is back in the free list
+static void release_tcb_slabs(void)
+{
+	while (tcb_slabs != NULL)
+	{
+		struct tcb_slab *next = tcb_slabs->next_slab;
+		free(tcb_slabs);
+		tcb_slabs = next;
+	}
+	free_tcbs = NULL;
+}
+
+// TCB slabs and the stack pool are shared by all the workers
+static spinlock_t alloc_lock = SPINLOCK_INIT;
+
 void free_thread(uthread_tcb *thread)
 {
-	uthread_ctx_destroy_stack(thread->stack_pointer);
-	free(thread);
+	spin_lock(&alloc_lock);
+	uthread_ctx_destroy_stack(thread->stack_pointer, thread->stack_size);
+	free_tcb(thread);
+	spin_unlock(&alloc_lock);
 }
 
+/*
+ * A worker is a kernel thread running threads, there is only one unless
+ * uthread_run_attr() is given several. Its idle thread is the context of the
+ * kernel thread itself, which it switches back to when there is nothing to run.
+ *
+ * With several workers, each one has its own deque of ready threads, which the
+ * others steal from once theirs is empty. A thread that yields or blocks is
+ * only made available to other workers once it is switched out (see
+ * uthread_finish_switch()), otherwise another worker could resume it before
+ * its context is saved.
+ */
+struct worker
+{
+	uthread_tcb *executing_thread;
+	uthread_tcb *idle_thread;
+
+	// Thread we just switched away from, see uthread_finish_switch()
+	uthread_tcb *previous_thread;
+
+	// Lock the previous thread blocked with, see uthread_block()
+	spinlock_t *unlock_after_switch;
+
+	// Schedules since the last I/O poll, see io_poll_due()
+	unsigned int io_schedules;
+
+	// Threads picked since the overflow queue was last looked at first
+	unsigned int local_picks;
+
+	unsigned int id;
+	pthread_t pthread;
+	struct deque deque;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
 // Use global state for the thread library (a bit like a singleton?)
-queue_t thread_queue;
-uthread_tcb *executing_thread;
-uthread_tcb *idle_thread;
+// Only threads that are ready to run are handed to the scheduling policy,
+// blocked threads only live in the wait queue of whatever they're blocked on
+const uthread_sched_ops_t *sched;
+unsigned int ready_count;
+
+// Threads put at the front of the ready queue, see uthread_unblock_next()
+unsigned int handoffs;
+
+struct worker *workers;
+unsigned int nworkers;
+bool multi_worker;
+
+// Ready threads that didn't fit in a worker's deque
+struct iqueue overflow_queue;
+spinlock_t overflow_lock = SPINLOCK_INIT;
+unsigned int overflow_len;
+
+// Parked workers wait for wake_seq to change, see park_worker()
+unsigned int parked_workers;
+unsigned int wake_seq;
+bool shutting_down;
+
+// Whether a parked worker sleeps in io_poll() rather than on wake_seq
+bool io_polling;
+
+static __thread struct worker *this_worker;
+
+// Threads can move to another worker across a context switch, so the address
+// of the current worker must be read again after each one. Never inlining this
+// function, nor letting the compiler analyze it, guarantees that.
+static __attribute__((noinline, noipa)) struct worker *current_worker(void)
+{
+	return this_worker;
+}
 
 struct uthread_tcb *uthread_current(void)
 {
-	return executing_thread;
+	return current_worker()->executing_thread;
+}
+
+struct sched_entity *uthread_sched_entity(struct uthread_tcb *thread)
+{
+	return &thread->se;
+}
+
+struct uthread_tcb *sched_entity_thread(struct sched_entity *se)
+{
+	return iqueue_entry(se, uthread_tcb, se);
+}
+
+void **uthread_sched_data(uthread_t thread)
+{
+	return &thread->se.data;
+}
+
+static void futex_wait(unsigned int *addr, unsigned int val)
+{
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void futex_wake(unsigned int *addr, int count)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+static void wake_workers(int count)
+{
+	__atomic_add_fetch(&wake_seq, 1, __ATOMIC_SEQ_CST);
+	futex_wake(&wake_seq, count);
+}
+
+// Make a ready thread available to every worker
+static void publish(uthread_tcb *thread)
+{
+	if (!deque_push(&current_worker()->deque, thread))
+	{
+		spin_lock(&overflow_lock);
+		iqueue_enqueue(&overflow_queue, &thread->se.node);
+		__atomic_add_fetch(&overflow_len, 1, __ATOMIC_RELAXED);
+		spin_unlock(&overflow_lock);
+	}
+
+	// pairs with the increment in park_worker(): either the parking worker
+	// sees the thread, or we see it parked
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&parked_workers, __ATOMIC_RELAXED) > 0)
+	{
+		wake_workers(1);
+		io_interrupt();
+	}
+}
+
+// Make a queue of ready threads available to every worker at once
+static void publish_all(struct iqueue *threads)
+{
+	unsigned int count = iqueue_length(threads);
+
+	spin_lock(&overflow_lock);
+	iqueue_splice(&overflow_queue, threads);
+	__atomic_add_fetch(&overflow_len, count, __ATOMIC_RELAXED);
+	spin_unlock(&overflow_lock);
+
+	// see publish()
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&parked_workers, __ATOMIC_RELAXED) > 0)
+	{
+		wake_workers(count < INT_MAX ? (int)count : INT_MAX);
+		io_interrupt();
+	}
+}
+
+// Take a ready thread from the overflow queue
+static uthread_tcb *take_overflow(void)
+{
+	if (__atomic_load_n(&overflow_len, __ATOMIC_RELAXED) == 0)
+	{
+		return NULL;
+	}
+
+	spin_lock(&overflow_lock);
+	struct iqueue_node *node = iqueue_dequeue(&overflow_queue);
+	if (node != NULL)
+	{
+		__atomic_sub_fetch(&overflow_len, 1, __ATOMIC_RELAXED);
+	}
+	spin_unlock(&overflow_lock);
+
+	if (node == NULL)
+	{
+		return NULL;
+	}
+
+	return sched_entity_thread(iqueue_entry(node, struct sched_entity, node));
+}
+
+/*
+ * Take a ready thread from the worker's deque, or from the other ones
+ *
+ * Threads that yield go back to their worker's deque, so it may never run
+ * empty. The overflow queue, where woken up threads also go, is then looked at
+ * first every OVERFLOW_PICK_EVERY picks so that they aren't starved.
+ */
+static uthread_tcb *steal_work(struct worker *w)
+{
+	uthread_tcb *thread;
+
+	if (++w->local_picks >= OVERFLOW_PICK_EVERY)
+	{
+		w->local_picks = 0;
+		thread = take_overflow();
+		if (thread != NULL)
+		{
+			return thread;
+		}
+	}
+
+	thread = deque_take(&w->deque);
+	if (thread != NULL)
+	{
+		return thread;
+	}
+
+	thread = take_overflow();
+	if (thread != NULL)
+	{
+		return thread;
+	}
+
+	for (unsigned int i = 1; i < nworkers; i++)
+	{
+		thread = deque_take(&workers[(w->id + i) % nworkers].deque);
+		if (thread != NULL)
+		{
+			return thread;
+		}
+	}
+
+	return NULL;
+}
+
+static bool work_available(void)
+{
+	if (__atomic_load_n(&overflow_len, __ATOMIC_RELAXED) > 0)
+	{
+		return true;
+	}
+
+	for (unsigned int i = 0; i < nworkers; i++)
+	{
+		if (!deque_empty(&workers[i].deque))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void shutdown_workers(void)
+{
+	__atomic_store_n(&shutting_down, true, __ATOMIC_SEQ_CST);
+	wake_workers(INT_MAX);
+}
+
+/*
+ * park_worker - Sleep until there may be work again
+ *
+ * Return: true if the library is shutting down
+ */
+static bool park_worker(void)
+{
+	unsigned int seq = __atomic_load_n(&wake_seq, __ATOMIC_SEQ_CST);
+	unsigned int parked = __atomic_add_fetch(&parked_workers, 1,
+											 __ATOMIC_SEQ_CST);
+
+	// Requests queued by our threads must be in flight before we sleep
+	io_flush();
+
+	// The poller unblocks threads before counting them out of I/O, so once
+	// it looks like no thread waits for I/O, the woken ones are visible
+	bool io_waiting = io_pending();
+
+	if (!__atomic_load_n(&shutting_down, __ATOMIC_SEQ_CST) &&
+		!work_available())
+	{
+		if (io_waiting &&
+			!__atomic_exchange_n(&io_polling, true, __ATOMIC_SEQ_CST))
+		{
+			// One parked worker sleeps until some I/O is ready
+			preempt_park();
+			io_poll(true);
+			__atomic_store_n(&io_polling, false, __ATOMIC_SEQ_CST);
+		}
+		else if (parked == nworkers && !io_waiting)
+		{
+			// Every worker is out of work, so no thread is left or the
+			// remaining ones are blocked for good
+			shutdown_workers();
+		}
+		else
+		{
+			preempt_park();
+			futex_wait(&wake_seq, seq);
+		}
+	}
+
+	__atomic_sub_fetch(&parked_workers, 1, __ATOMIC_SEQ_CST);
+	return __atomic_load_n(&shutting_down, __ATOMIC_SEQ_CST);
+}
+
+bool uthread_has_ready(void)
+{
+	if (multi_worker)
+	{
+		return !deque_empty(&current_worker()->deque) ||
+			   __atomic_load_n(&overflow_len, __ATOMIC_RELAXED) > 0;
+	}
+
+	return ready_count > 0;
+}
+
+static void make_ready(uthread_tcb *thread)
+{
+	thread->state = READY;
+
+	if (multi_worker)
+	{
+		// the running thread is published once it is switched out
+		if (thread != uthread_current())
+		{
+			publish(thread);
+		}
+		return;
+	}
+
+	ready_count++;
+	sched->enqueue_ready(thread);
+}
+
+static uthread_tcb *pick_next(struct worker *w)
+{
+	if (multi_worker)
+	{
+		return steal_work(w);
+	}
+
+	uthread_tcb *next = sched->pick_next();
+
+	if (next != NULL)
+	{
+		ready_count--;
+	}
+
+	return next;
+}
+
+void uthread_finish_switch(void)
+{
+	struct worker *w = current_worker();
+	uthread_tcb *previous_thread = w->previous_thread;
+
+	// Zombie thread, collect
+	// This can't be done by the exiting thread itself since it is still
+	// running on its stack until the switch is complete
+	if (previous_thread->state == EXITED)
+	{
+		free_thread(previous_thread);
+	}
+	else if (multi_worker && previous_thread->state == READY)
+	{
+		publish(previous_thread);
+	}
+
+	if (w->unlock_after_switch != NULL)
+	{
+		spin_unlock(w->unlock_after_switch);
+		w->unlock_after_switch = NULL;
+	}
+}
+
+/*
+ * uthread_schedule - Switch to the next ready thread
+ *
+ * The currently executing thread must already be made ready if it is to be
+ * scheduled again. If no thread is ready, execution goes back to the idle
+ * thread. Must be called with preemption disabled.
+ */
+static void uthread_schedule(void)
+{
+	struct worker *w = current_worker();
+	uthread_tcb *current_thread = w->executing_thread;
+
+	// not while a blocking thread still holds the lock of a wait queue, which
+	// could be the one of a file descriptor
+	if (w->unlock_after_switch == NULL && io_poll_due(&w->io_schedules))
+	{
+		io_poll(false);
+	}
+
+	uthread_tcb *next_thread = pick_next(w);
+
+	if (next_thread == NULL)
+	{
+		// No threads remaining in the queue, return to idle thread to finish
+		// (with several workers, the yielding thread isn't in the queue)
+		next_thread = current_thread->state == READY ? current_thread
+													 : w->idle_thread;
+	}
+
+	next_thread->state = RUNNING;
+
+	// The only valid thread is the one we just yielded from, so just continue execution
+	if (next_thread == current_thread)
+	{
+		return;
+	}
+
+	// Make sure to update executing_thread before we context switch
+	w->previous_thread = current_thread;
+	w->executing_thread = next_thread;
+
+	// switch to the next thread to run
+	// w must not be used after this point, we may come back on another worker
+	uthread_ctx_switch(&current_thread->uctx, &next_thread->uctx);
+
+	uthread_finish_switch();
+}
+
+static void stop_sched(void)
+{
+	if (sched->fini != NULL)
+	{
+		sched->fini();
+	}
+}
+
+/*
+ * worker_loop - Run threads until the library shuts down
+ *
+ * Executed by the idle thread of every worker, with preemption disabled.
+ */
+static void worker_loop(void)
+{
+	do
+	{
+		uthread_schedule();
+	} while (!park_worker());
+}
+
+static void *worker_main(void *arg)
+{
+	this_worker = arg;
+
+	preempt_disable();
+
+	// without a timer, the worker simply runs its threads without preemption
+	preempt_start_worker();
+
+	worker_loop();
+
+	preempt_stop_worker();
+
+	return NULL;
+}
+
+void uthread_run_attr_init(uthread_run_attr_t *attr)
+{
+	attr->preempt = false;
+	attr->quantum_us = UTHREAD_QUANTUM_DEFAULT;
+	attr->clock = UTHREAD_CLOCK_VIRTUAL;
+	attr->sched = UTHREAD_SCHED_FIFO;
+	attr->sched_ops = NULL;
+	attr->workers = 1;
+	attr->io_uring = true;
+	attr->helpers = UTHREAD_HELPERS_DEFAULT;
 }
 
 int uthread_run(bool preempt, uthread_func_t func, void *arg)
 {
-	thread_queue = queue_create();
+	uthread_run_attr_t attr;
+
+	uthread_run_attr_init(&attr);
+	attr.preempt = preempt;
+
+	return uthread_run_attr(&attr, func, arg);
+}
+
+int uthread_run_mt(unsigned int workers, bool preempt, uthread_func_t func,
+				   void *arg)
+{
+	uthread_run_attr_t attr;
+
+	uthread_run_attr_init(&attr);
+	attr.preempt = preempt;
+	attr.workers = workers;
+
+	return uthread_run_attr(&attr, func, arg);
+}
+
+// Free everything uthread_run_attr() allocated, once no thread is left
+static void run_cleanup(unsigned int idle_threads)
+{
+	for (unsigned int i = 0; i < idle_threads; i++)
+	{
+		free_tcb(workers[i].idle_thread);
+	}
+	release_tcb_slabs();
+	stop_sched();
+	free(workers);
+	workers = NULL;
+}
+
+int uthread_run_attr(const uthread_run_attr_t *attr, uthread_func_t func,
+					 void *arg)
+{
+	uthread_run_attr_t default_attr;
 
-	// register current thread as the "idle"
-	idle_thread = malloc(sizeof(uthread_tcb));
+	if (attr == NULL)
+	{
+		uthread_run_attr_init(&default_attr);
+		attr = &default_attr;
+	}
 
-	if (idle_thread == NULL)
+	switch (attr->sched)
 	{
-		queue_destroy(thread_queue);
+	case UTHREAD_SCHED_FIFO:
+		sched = &sched_fifo_ops;
+		break;
+	case UTHREAD_SCHED_MLFQ:
+		sched = &sched_mlfq_ops;
+		break;
+	case UTHREAD_SCHED_FAIR:
+		sched = &sched_fair_ops;
+		break;
+	case UTHREAD_SCHED_LIFO:
+		sched = &sched_lifo_ops;
+		break;
+	default:
 		return -1;
 	}
 
-	// Create the initial thread
-	if (uthread_create(func, arg) == -1)
+	if (attr->sched_ops != NULL)
+	{
+		sched = attr->sched_ops;
+	}
+
+	// Several workers always use the built-in work-stealing FIFO scheduling
+	if (attr->workers == 0 || attr->helpers == 0 ||
+		(attr->workers > 1 &&
+		 (attr->sched != UTHREAD_SCHED_FIFO || attr->sched_ops != NULL)))
 	{
-		free(idle_thread);
-		queue_destroy(thread_queue);
 		return -1;
 	}
 
-	uthread_tcb *next_thread;
+	nworkers = attr->workers;
+	multi_worker = nworkers > 1;
+	workers = aligned_alloc(CACHE_LINE_SIZE, nworkers * sizeof(struct worker));
 
-	// Context switch to the init thread
-	// Special case since we're switching out of idle thread, which doesn't go in the queue
-	int status = queue_dequeue(thread_queue, (void **)&next_thread);
-	if (status == -1)
+	if (workers == NULL)
 	{
-		free(idle_thread);
-		queue_destroy(thread_queue);
 		return -1;
 	}
 
-	next_thread->state = RUNNING;
-	executing_thread = next_thread;
+	ready_count = 0;
+	if (sched->init != NULL && sched->init() == -1)
+	{
+		free(workers);
+		workers = NULL;
+		return -1;
+	}
+
+	iqueue_init(&overflow_queue);
+	overflow_len = 0;
+	parked_workers = 0;
+	shutting_down = false;
+	io_polling = false;
 
-	preempt_start(preempt);
+	for (unsigned int i = 0; i < nworkers; i++)
+	{
+		struct worker *w = &workers[i];
+
+		// register the kernel thread of each worker as its "idle" thread
+		w->idle_thread = alloc_tcb();
+
+		if (w->idle_thread == NULL)
+		{
+			run_cleanup(i);
+			return -1;
+		}
+
+		// The idle thread doesn't go in the ready queue, it's only switched
+		// back to once there is nothing left to run
+		w->idle_thread->state = RUNNING;
+		w->executing_thread = w->idle_thread;
+		w->previous_thread = NULL;
+		w->unlock_after_switch = NULL;
+		w->io_schedules = 0;
+		w->local_picks = 0;
+		w->id = i;
+		deque_init(&w->deque);
+	}
+
+	// The calling thread is the first worker
+	this_worker = &workers[0];
+
+	if (io_start(attr) == -1)
+	{
+		run_cleanup(nworkers);
+		return -1;
+	}
 
 	// Disable preemption in the idle thread
 	preempt_disable();
 
-	// Start execution of threads
-	uthread_ctx_switch(&idle_thread->uctx, &next_thread->uctx);
+	if (preempt_start(attr) == -1)
+	{
+		preempt_stop();
+		io_stop();
+		run_cleanup(nworkers);
+		return -1;
+	}
+
+	for (unsigned int i = 1; i < nworkers; i++)
+	{
+		if (pthread_create(&workers[i].pthread, NULL, worker_main,
+						   &workers[i]) != 0)
+		{
+			// no thread was created yet, the other workers just stop
+			shutdown_workers();
+			for (unsigned int j = 1; j < i; j++)
+			{
+				pthread_join(workers[j].pthread, NULL);
+			}
+			preempt_stop();
+			io_stop();
+			run_cleanup(nworkers);
+			return -1;
+		}
+	}
+
+	// Create the initial thread
+	int ret = uthread_create(func, arg);
+
+	if (ret == 0)
+	{
+		// Start execution of threads
+		worker_loop();
+	}
+	else
+	{
+		shutdown_workers();
+	}
+
+	for (unsigned int i = 1; i < nworkers; i++)
+	{
+		pthread_join(workers[i].pthread, NULL);
+	}
 
 	preempt_stop();
+	io_stop();
 
 	// free remaining resourecs
-	free(idle_thread);
-	queue_destroy(thread_queue);
+	run_cleanup(nworkers);
 
-	return 0;
+	return ret;
+}
+
+void uthread_attr_init(uthread_attr_t *attr)
+{
+	attr->stack_size = UTHREAD_STACK_DEFAULT;
+	attr->priority = 0;
+	attr->weight = UTHREAD_WEIGHT_DEFAULT;
 }
 
 int uthread_create(uthread_func_t func, void *arg)
 {
-	// create new thread tcb
-	uthread_tcb *new_tcb = malloc(sizeof(uthread_tcb));
+	return uthread_create_attr(NULL, func, arg);
+}
 
-	if (new_tcb == NULL)
+int uthread_create_attr(const uthread_attr_t *attr, uthread_func_t func,
+						void *arg)
+{
+	uthread_attr_t default_attr;
+
+	if (attr == NULL)
 	{
-		return -1;
+		uthread_attr_init(&default_attr);
+		attr = &default_attr;
 	}
 
-	new_tcb->stack_pointer = uthread_ctx_alloc_stack();
+	// rounding up to pages, plus the guard page, must not wrap around
+	size_t page_size = sysconf(_SC_PAGESIZE);
 
-	if (new_tcb->stack_pointer == NULL)
+	if (attr->stack_size < UTHREAD_STACK_MIN ||
+		attr->stack_size > SIZE_MAX - 2 * page_size || attr->priority < 0 ||
+		attr->priority >= UTHREAD_PRIO_LEVELS || attr->weight == 0)
 	{
-		// only need to free the tcb, since stack failed to malloc
-		free(new_tcb);
 		return -1;
 	}
 
-	new_tcb->state = READY;
-
-	// queueing and setting up thread context should be atomic
+	// the stack pool is shared with the scheduler, which recycles stacks of
+	// exited threads, so allocating and queueing the new thread should be atomic
 	// being interrupted could result in a broken queue, or an uninitialized thread in the queue
 	preempt_disable();
 
-	// queue the new thread
-	if (queue_enqueue(thread_queue, new_tcb) == -1)
+	// create new thread tcb
+	spin_lock(&alloc_lock);
+	uthread_tcb *new_tcb = alloc_tcb();
+
+	if (new_tcb != NULL)
 	{
-		free_thread(new_tcb);
+		new_tcb->stack_size = attr->stack_size;
+		new_tcb->stack_pointer = uthread_ctx_alloc_stack(new_tcb->stack_size);
+
+		if (new_tcb->stack_pointer == NULL)
+		{
+			// only need to free the tcb, since stack failed to malloc
+			free_tcb(new_tcb);
+			new_tcb = NULL;
+		}
+	}
+	spin_unlock(&alloc_lock);
+
+	if (new_tcb == NULL)
+	{
+		preempt_enable();
 		return -1;
 	}
 
 	// initialize user thread context
-	if (uthread_ctx_init(&new_tcb->uctx, new_tcb->stack_pointer, func, arg) == -1)
+	if (uthread_ctx_init(&new_tcb->uctx, new_tcb->stack_pointer,
+						 new_tcb->stack_size, func, arg) == -1)
+	{
+		free_thread(new_tcb);
+		preempt_enable();
+		return -1;
+	}
+
+	new_tcb->se.priority = attr->priority;
+	new_tcb->se.weight = attr->weight;
+	new_tcb->se.data = NULL;
+	if (sched->on_create != NULL && sched->on_create(new_tcb, attr) == -1)
 	{
 		free_thread(new_tcb);
+		preempt_enable();
 		return -1;
 	}
 
+	// queue the new thread
+	make_ready(new_tcb);
+	preempt_ready();
+
 	preempt_enable();
 
 	return 0;
@@ -148,76 +862,137 @@ void uthread_yield(void)
 	// If it is interrupted, the thread it tries to schedule next could be wrong
 	preempt_disable();
 
-	uthread_tcb *next_thread;
-
 	// Requeue thread we're yielding from
-	// If it's a zombie or blocked thread, make sure to leave the state untouched
 	// We do this before dequeueing in case the yielding thread is the only one
-	if (executing_thread->state == RUNNING)
-	{
-		executing_thread->state = READY;
-	}
-	queue_enqueue(thread_queue, executing_thread);
+	make_ready(uthread_current());
 
-	int len = queue_length(thread_queue);
-	for (int i = 0; i < len; i++)
-	{
-		queue_dequeue(thread_queue, (void **)&next_thread);
+	uthread_schedule();
 
-		// Zombie thread, collect
-		if (next_thread->state == EXITED)
-		{
-			free_thread(next_thread);
-		}
-		else if (next_thread->state == BLOCKED)
-		{
-			// cycle to back of the queue
-			queue_enqueue(thread_queue, next_thread);
-		}
-		else
-		{
-			// The only valid thread is the one we just yielded from, so just continue execution
-			if (next_thread == executing_thread)
-			{
-				preempt_enable();
-				return;
-			}
-			// found a ready thread, move on to context switching to it
-			break;
-		}
+	preempt_enable();
+}
+
+void uthread_preempt(void)
+{
+	preempt_disable();
+
+	uthread_tcb *current_thread = uthread_current();
+
+	if (sched->on_tick != NULL && !sched->on_tick(current_thread))
+	{
+		preempt_enable();
+		return;
 	}
+	make_ready(current_thread);
+	uthread_schedule();
 
-	// No threads remaining in the queue, return to idle thread to finish
-	if (queue_length(thread_queue) == 0)
+	preempt_enable();
+}
+
+int uthread_set_priority(int priority)
+{
+	if (priority < 0 || priority >= UTHREAD_PRIO_LEVELS)
 	{
-		uthread_ctx_switch(&executing_thread->uctx, &idle_thread->uctx);
+		return -1;
 	}
 
-	next_thread->state = RUNNING;
+	preempt_disable();
 
-	// Make sure to update executing_thread before we context switch
-	uthread_tcb *previous_thread = executing_thread;
-	executing_thread = next_thread;
+	uthread_tcb *current_thread = uthread_current();
 
-	// switch to the next thread to run
-	uthread_ctx_switch(&previous_thread->uctx, &next_thread->uctx);
+	current_thread->se.priority = priority;
+	if (sched->on_priority != NULL)
+	{
+		sched->on_priority(current_thread, priority);
+	}
 
 	preempt_enable();
+
+	return 0;
 }
 
 void uthread_exit(void)
 {
-	executing_thread->state = EXITED;
-	uthread_yield();
+	preempt_disable();
+
+	uthread_tcb *current_thread = uthread_current();
+
+	if (sched->on_exit != NULL)
+	{
+		sched->on_exit(current_thread);
+	}
+
+	// Zombie threads don't go back in the ready queue, they are collected by
+	// the next thread
+	current_thread->state = EXITED;
+	uthread_schedule();
 }
 
-void uthread_block(void)
+void uthread_block(spinlock_t *lock)
 {
-	executing_thread->state = BLOCKED;
-	uthread_yield();
+	// preemption is already disabled by the caller
+	struct worker *w = current_worker();
+	uthread_tcb *current_thread = w->executing_thread;
+
+	current_thread->state = BLOCKED;
+	w->unlock_after_switch = lock;
+
+	if (sched->on_block != NULL)
+	{
+		sched->on_block(current_thread);
+	}
+
+	uthread_schedule();
 }
 
 void uthread_unblock(struct uthread_tcb *uthread)
 {
+	make_ready(uthread);
+	preempt_ready();
+}
+
+void uthread_unblock_next(struct uthread_tcb *uthread)
+{
+	if (multi_worker || sched != &sched_fifo_ops ||
+		++handoffs % HANDOFF_MAX == 0)
+	{
+		uthread_unblock(uthread);
+		return;
+	}
+
 	uthread->state = READY;
+	ready_count++;
+	fifo_enqueue_ready_next(uthread);
+	preempt_ready();
+}
+
+void uthread_unblock_all(struct iqueue *threads)
+{
+	if (iqueue_length(threads) == 0)
+	{
+		return;
+	}
+
+	// The spliced threads keep their blocked state until they run, nothing
+	// looks at the state of a thread that is waiting in a ready queue
+	if (multi_worker)
+	{
+		publish_all(threads);
+	}
+	else if (sched == &sched_fifo_ops)
+	{
+		ready_count += iqueue_length(threads);
+		fifo_enqueue_ready_all(threads);
+	}
+	else
+	{
+		struct iqueue_node *node;
+
+		while ((node = iqueue_dequeue(threads)) != NULL)
+		{
+			make_ready(
+				sched_entity_thread(iqueue_entry(node, struct sched_entity, node)));
+		}
+	}
+
+	preempt_ready();
 }
@@ -2,6 +2,25 @@
 #define _UTHREAD_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Default size of a thread's stack (in bytes) */
+#define UTHREAD_STACK_DEFAULT 32768
+
+/* Smallest stack size accepted by uthread_create_attr() (in bytes) */
+#define UTHREAD_STACK_MIN 8192
+
+/* Number of thread priority levels, 0 being the highest priority */
+#define UTHREAD_PRIO_LEVELS 8
+
+/* Default weight of a thread for fair scheduling */
+#define UTHREAD_WEIGHT_DEFAULT 1024
+
+/*
+ * uthread_t - Thread handle, as seen by scheduling policies
+ */
+typedef struct uthread_tcb *uthread_t;
 
 /*
  * uthread_func_t - Thread function type
@@ -9,6 +28,165 @@
  */
 typedef void (*uthread_func_t)(void *arg);
 
+/*
+ * uthread_attr_t - Thread creation attributes
+ * @stack_size: Size of the thread's stack (in bytes), rounded up to a whole
+ *	number of pages
+ * @priority: Priority of the thread, from 0 (highest) to
+ *	UTHREAD_PRIO_LEVELS - 1, see uthread_set_priority()
+ * @weight: Share of the CPU the thread gets with fair scheduling, relative to
+ *	UTHREAD_WEIGHT_DEFAULT (e.g. twice as much CPU time for 2048)
+ *
+ * Attributes must be initialized with uthread_attr_init() before individual
+ * fields are changed, so that fields added later get their default value.
+ */
+typedef struct uthread_attr
+{
+	size_t stack_size;
+	int priority;
+	unsigned int weight;
+} uthread_attr_t;
+
+/*
+ * uthread_attr_init - Initialize thread creation attributes
+ * @attr: Attributes to initialize
+ *
+ * Set every attribute in @attr to its default value.
+ */
+void uthread_attr_init(uthread_attr_t *attr);
+
+/* Default preemption quantum (in microseconds), i.e. 100 Hz */
+#define UTHREAD_QUANTUM_DEFAULT 10000
+
+/* Default number of helper kernel threads, see uthread_offload() */
+#define UTHREAD_HELPERS_DEFAULT 4
+
+/*
+ * uthread_clock_t - Clock measuring preemption quanta
+ * @UTHREAD_CLOCK_VIRTUAL: CPU time consumed by the process in user mode
+ * @UTHREAD_CLOCK_MONOTONIC: Elapsed (wall-clock) time
+ * @UTHREAD_CLOCK_THREAD_CPU: CPU time consumed by the process' thread running
+ *	the library
+ */
+typedef enum uthread_clock
+{
+	UTHREAD_CLOCK_VIRTUAL,
+	UTHREAD_CLOCK_MONOTONIC,
+	UTHREAD_CLOCK_THREAD_CPU
+} uthread_clock_t;
+
+/*
+ * uthread_sched_t - Scheduling policy
+ * @UTHREAD_SCHED_FIFO: Round-robin between all ready threads, in the order
+ *	they became ready
+ * @UTHREAD_SCHED_MLFQ: Multilevel feedback queue. Threads are scheduled
+ *	round-robin within a priority level, and higher levels always go first.
+ *	A thread that used a whole quantum of CPU time at its level, over one or
+ *	more runs, is demoted one level, a thread that blocks is otherwise
+ *	promoted one level (up to its priority), and every thread is
+ *	periodically moved back to its priority level.
+ * @UTHREAD_SCHED_FAIR: Fair share. The thread that used the least CPU time,
+ *	divided by its weight, always runs next. Threads that block don't
+ *	accumulate credit while blocked.
+ * @UTHREAD_SCHED_LIFO: Threads that are woken up or created run next, ahead
+ *	of threads that yielded or got preempted, which favors cache locality
+ *	between a thread and the one it wakes up.
+ */
+typedef enum uthread_sched
+{
+	UTHREAD_SCHED_FIFO,
+	UTHREAD_SCHED_MLFQ,
+	UTHREAD_SCHED_FAIR,
+	UTHREAD_SCHED_LIFO
+} uthread_sched_t;
+
+/*
+ * uthread_sched_ops_t - Scheduling policy operations
+ * @init: Set up the policy, before any thread is created. Return 0 in case of
+ *	success, -1 in case of failure.
+ * @fini: Tear down the policy, once every thread has exited
+ * @on_create: Set up the scheduling state of new @thread, created with @attr.
+ *	Return 0 in case of success, -1 in case of failure (thread creation then
+ *	fails). Should reserve whatever memory @enqueue_ready needs.
+ * @enqueue_ready: @thread is ready to run: it was just created, unblocked, or
+ *	it is the running thread which yields or got preempted. Must not fail.
+ * @pick_next: Remove the next thread to run from the ready threads and return
+ *	it, or return NULL if no thread is ready
+ * @on_block: Running @thread is about to block
+ * @on_tick: A preemption tick interrupted running @thread. Return true to
+ *	preempt it (@enqueue_ready follows), or false to let it run until the
+ *	next tick, e.g., if it was only scheduled right before this one.
+ * @on_exit: Running @thread is exiting
+ * @on_priority: The priority of running @thread was changed to @priority
+ *
+ * The library calls these operations with preemption disabled, and never
+ * calls @enqueue_ready on a thread that is already ready. Every operation
+ * except @enqueue_ready and @pick_next is optional and can be NULL.
+ * Per-thread state can be kept with uthread_sched_data().
+ */
+typedef struct uthread_sched_ops
+{
+	int (*init)(void);
+	void (*fini)(void);
+	int (*on_create)(uthread_t thread, const uthread_attr_t *attr);
+	void (*enqueue_ready)(uthread_t thread);
+	uthread_t (*pick_next)(void);
+	void (*on_block)(uthread_t thread);
+	bool (*on_tick)(uthread_t thread);
+	void (*on_exit)(uthread_t thread);
+	void (*on_priority)(uthread_t thread, int priority);
+} uthread_sched_ops_t;
+
+/*
+ * uthread_sched_data - Per-thread data of the scheduling policy
+ * @thread: Thread to get the data of
+ *
+ * Return: Pointer to a pointer-sized slot of @thread that is reserved to
+ * custom scheduling policies, initialized to NULL when @thread is created.
+ */
+void **uthread_sched_data(uthread_t thread);
+
+/*
+ * uthread_run_attr_t - Library run attributes
+ * @preempt: Preemption enable
+ * @quantum_us: Time a thread may run before being preempted (in microseconds)
+ * @clock: Clock measuring @quantum_us
+ * @sched: Scheduling policy
+ * @sched_ops: Custom scheduling policy, overriding @sched if not NULL
+ * @workers: Number of kernel threads running threads. With more than one,
+ *	each worker has its own ready queue and steals threads from the others
+ *	when it runs out; only FIFO scheduling is supported then, and with a
+ *	virtual clock each worker's quantum is measured in its own CPU time.
+ * @io_uring: Submit file I/O (see io.h) to an io_uring. Without it, or if the
+ *	kernel doesn't support io_uring, file I/O is run by helper kernel threads.
+ * @helpers: Number of helper kernel threads, started on first use
+ *
+ * Attributes must be initialized with uthread_run_attr_init() before individual
+ * fields are changed, so that fields added later get their default value.
+ */
+typedef struct uthread_run_attr
+{
+	bool preempt;
+	unsigned int quantum_us;
+	uthread_clock_t clock;
+	uthread_sched_t sched;
+	const uthread_sched_ops_t *sched_ops;
+	unsigned int workers;
+	bool io_uring;
+	unsigned int helpers;
+} uthread_run_attr_t;
+
+/*
+ * uthread_run_attr_init - Initialize library run attributes
+ * @attr: Attributes to initialize
+ *
+ * Set every attribute in @attr to its default value: no preemption, a quantum
+ * of UTHREAD_QUANTUM_DEFAULT of virtual time once enabled, FIFO scheduling,
+ * a single worker, file I/O through io_uring, and UTHREAD_HELPERS_DEFAULT
+ * helpers.
+ */
+void uthread_run_attr_init(uthread_run_attr_t *attr);
+
 /*
  * uthread_run - Run the multithreading library
  * @preempt: Preemption enable
@@ -26,6 +204,37 @@ typedef void (*uthread_func_t)(void *arg);
  */
 int uthread_run(bool preempt, uthread_func_t func, void *arg);
 
+/*
+ * uthread_run_mt - Run the multithreading library on several kernel threads
+ * @workers: Number of kernel threads running threads
+ * @preempt: Preemption enable
+ * @func: Function of the first thread to start
+ * @arg: Argument to be passed to the first thread
+ *
+ * Same as uthread_run(), but threads are run by @workers kernel threads, the
+ * calling thread being one of them. Threads can move from one worker to
+ * another whenever they yield or block.
+ *
+ * Return: 0 in case of success, -1 in case of failure (e.g., memory allocation,
+ * context creation, kernel thread creation).
+ */
+int uthread_run_mt(unsigned int workers, bool preempt, uthread_func_t func,
+				   void *arg);
+
+/*
+ * uthread_run_attr - Run the multithreading library with specific attributes
+ * @attr: Run attributes, or NULL for the defaults
+ * @func: Function of the first thread to start
+ * @arg: Argument to be passed to the first thread
+ *
+ * Same as uthread_run(), but the library is configured according to @attr.
+ *
+ * Return: 0 in case of success, -1 in case of failure (e.g., invalid
+ * attributes, memory allocation, context creation, timer creation).
+ */
+int uthread_run_attr(const uthread_run_attr_t *attr, uthread_func_t func,
+					 void *arg);
+
 /*
  * uthread_create - Create a new thread
  * @func: Function to be executed by the thread
@@ -39,6 +248,20 @@ int uthread_run(bool preempt, uthread_func_t func, void *arg);
  */
 int uthread_create(uthread_func_t func, void *arg);
 
+/*
+ * uthread_create_attr - Create a new thread with specific attributes
+ * @attr: Creation attributes, or NULL for the defaults
+ * @func: Function to be executed by the thread
+ * @arg: Argument to be passed to the thread
+ *
+ * Same as uthread_create(), but the new thread is set up according to @attr.
+ *
+ * Return: 0 in case of success, -1 in case of failure (e.g., invalid
+ * attributes, memory allocation, context creation).
+ */
+int uthread_create_attr(const uthread_attr_t *attr, uthread_func_t func,
+						void *arg);
+
 /*
  * uthread_yield - Yield execution
  *
@@ -47,6 +270,40 @@ int uthread_create(uthread_func_t func, void *arg);
  */
 void uthread_yield(void);
 
+/*
+ * uthread_set_priority - Set the priority of the currently running thread
+ * @priority: New priority, from 0 (highest) to UTHREAD_PRIO_LEVELS - 1
+ *
+ * Only priority-based scheduling policies take priorities into account.
+ *
+ * Return: 0 in case of success, -1 if @priority is out of range.
+ */
+int uthread_set_priority(int priority);
+
+/*
+ * uthread_sleep_ns - Sleep for a given time
+ * @ns: Time to sleep (in nanoseconds)
+ *
+ * Block the currently running thread for at least @ns nanoseconds, while other
+ * threads keep running. Once only sleeping threads are left, the library
+ * sleeps in the kernel until the first one is due.
+ *
+ * Return: 0 once the time elapsed, or -1 in case of failure (memory allocation)
+ */
+int uthread_sleep_ns(uint64_t ns);
+
+/*
+ * uthread_sleep_until - Sleep until a given time
+ * @deadline_ns: Time to wake up at, in nanoseconds of CLOCK_MONOTONIC
+ *
+ * Same as uthread_sleep_ns(), but with an absolute deadline. Returns right away
+ * if @deadline_ns already passed.
+ *
+ * Return: 0 once @deadline_ns passed, or -1 in case of failure (memory
+ * allocation)
+ */
+int uthread_sleep_until(uint64_t deadline_ns);
+
 /*
  * uthread_exit - Exit from currently running thread
  *
@@ -57,4 +314,16 @@ void uthread_yield(void);
  */
 void uthread_exit(void);
 
+/*
+ * uthread_set_stack_watermark - Configure the stack pool
+ * @count: Number of idle stacks to keep resident
+ *
+ * Stacks of exited threads are kept in a pool and recycled by later calls to
+ * uthread_create(). Once more than @count stacks are resident in the pool, the
+ * memory of the extra stacks that stayed idle for a while is handed back to the
+ * kernel, coldest first (they remain mapped and can still be recycled). The
+ * default is 64 stacks.
+ */
+void uthread_set_stack_watermark(unsigned int count);
+
 #endif /* _THREAD_H */